@@ -0,0 +1,259 @@
+#ifndef BPTREE_ASYNCIO_H
+#define BPTREE_ASYNCIO_H
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "utility.h"
+#include "error.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define BPTREE_HAS_URING 1
+#else
+#define BPTREE_HAS_URING 0
+#endif
+
+namespace arima_kana {
+
+    /// @read_req one positional read; res is the byte count or -errno
+    struct read_req {
+      int fd;
+      void *buf;
+      size_t len;
+      size_t off;
+      long res;
+    };
+
+#if BPTREE_HAS_URING
+
+    /// @Uring
+    /// a bare io_uring driven through the raw system calls
+    /// (liburing is not required); reads only
+    class Uring {
+      int ring_fd = -1;
+      unsigned entries = 0;
+      void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED;
+      size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+      unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+      unsigned *cq_head, *cq_tail, *cq_mask;
+      io_uring_sqe *sqes = nullptr;
+      io_uring_cqe *cqes = nullptr;
+
+      void close_ring() {
+        if (sqes != nullptr) munmap(sqes, sqes_len);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+        if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_len);
+        if (ring_fd >= 0) close(ring_fd);
+        sqes = nullptr;
+        sq_ptr = cq_ptr = MAP_FAILED;
+        ring_fd = -1;
+      }
+
+      bool push(const read_req &r, uint64_t tag) {
+        unsigned tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == entries) return false;
+        unsigned idx = tail & *sq_mask;
+        io_uring_sqe &e = sqes[idx];
+        memset(&e, 0, sizeof(e));
+        e.opcode = IORING_OP_READ;
+        e.fd = r.fd;
+        e.addr = reinterpret_cast<uint64_t>(r.buf);
+        e.len = unsigned(r.len);
+        e.off = r.off;
+        e.user_data = tag;
+        sq_array[idx] = idx;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+
+      template<class F>
+      void reap(F &&fn) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+          const io_uring_cqe &c = cqes[head & *cq_mask];
+          fn(c.user_data, long(c.res));
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+      }
+
+    public:
+      /// false if the kernel refuses a ring (old kernel, seccomp, ...)
+      bool open(unsigned depth) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int fd = int(syscall(__NR_io_uring_setup, depth, &p));
+        if (fd < 0) return false;
+        ring_fd = fd;
+        entries = p.sq_entries;
+        sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sq_len = cq_len = sq_len > cq_len ? sq_len : cq_len;
+        sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) return close_ring(), false;
+        cq_ptr = single ? sq_ptr :
+                 mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) return close_ring(), false;
+        sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+        void *s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (s == MAP_FAILED) return close_ring(), false;
+        sqes = static_cast<io_uring_sqe *>(s);
+        auto sq = static_cast<char *>(sq_ptr), cq = static_cast<char *>(cq_ptr);
+        sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        return true;
+      }
+
+      ~Uring() {
+        close_ring();
+      }
+
+      /// keeps up to a ring's worth of reads in flight,
+      /// calling done(i) as request i completes
+      template<class F>
+      void read_all(read_req *reqs, size_t n, F &&done) {
+        size_t next = 0, finished = 0, in_flight = 0;
+        unsigned unsubmitted = 0;
+        while (finished < n) {
+          while (next < n && in_flight < entries && push(reqs[next], next)) {
+            ++next, ++in_flight, ++unsubmitted;
+          }
+          int r = int(syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+          if (r < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            error("io_uring_enter failed");
+          }
+          unsubmitted -= unsigned(r) < unsubmitted ? unsigned(r) : unsubmitted;
+          reap([&](uint64_t tag, long res) {
+            reqs[tag].res = res;
+            --in_flight, ++finished;
+            done(size_t(tag));
+          });
+        }
+      }
+    };
+
+#endif
+
+    /// @Read_Pool
+    /// blocking preads on a few worker threads,
+    /// for when io_uring is not available
+    class Read_Pool {
+      std::mutex mu;
+      std::condition_variable work, finished;
+      vector<std::thread> threads;
+      read_req *reqs = nullptr;
+      size_t next = 0, n = 0;
+      vector<size_t> completed;
+      bool stop = false;
+
+      void run() {
+        std::unique_lock<std::mutex> lk(mu);
+        while (true) {
+          work.wait(lk, [this] { return stop || next < n; });
+          if (stop) return;
+          read_req &r = reqs[next++];
+          lk.unlock();
+          long res = long(pread(r.fd, r.buf, r.len, off_t(r.off)));
+          r.res = res < 0 ? -errno : res;
+          lk.lock();
+          completed.push_back(size_t(&r - reqs));
+          finished.notify_one();
+        }
+      }
+
+    public:
+      explicit Read_Pool(size_t workers) {
+        for (size_t i = 0; i < workers; ++i) threads.push_back(std::thread([this] { run(); }));
+      }
+
+      ~Read_Pool() {
+        {
+          std::lock_guard<std::mutex> lk(mu);
+          stop = true;
+        }
+        work.notify_all();
+        for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+      }
+
+      template<class F>
+      void read_all(read_req *rs, size_t cnt, F &&done) {
+        std::unique_lock<std::mutex> lk(mu);
+        reqs = rs, n = cnt, next = 0;
+        work.notify_all();
+        vector<size_t> ready;
+        for (size_t seen = 0; seen < cnt;) {
+          finished.wait(lk, [this] { return completed.size() != 0; });
+          ready.clear();
+          for (size_t i = 0; i < completed.size(); ++i) ready.push_back(completed[i]);
+          completed.clear();
+          lk.unlock();
+          for (size_t i = 0; i < ready.size(); ++i) done(ready[i]);
+          seen += ready.size();
+          lk.lock();
+        }
+        reqs = nullptr, n = next = 0;
+      }
+    };
+
+    /// @Async_Reader
+    /// issues a whole set of reads at once and hands them back
+    /// in completion order: through io_uring when the kernel allows it,
+    /// otherwise through a Read_Pool
+    class Async_Reader {
+#if BPTREE_HAS_URING
+      Uring ring;
+#endif
+      bool ring_ok = false;
+      size_t workers;
+      Read_Pool *pool = nullptr;// started on first use
+
+    public:
+      explicit Async_Reader(unsigned depth = 64, size_t workers = 4, bool try_uring = true) : workers(workers) {
+#if BPTREE_HAS_URING
+        if (try_uring) ring_ok = ring.open(depth);
+#endif
+      }
+
+      ~Async_Reader() {
+        delete pool;
+      }
+
+      bool uring() const {
+        return ring_ok;
+      }
+
+      /// calls done(i) for each of the n requests as it completes
+      template<class F>
+      void read_all(read_req *reqs, size_t n, F &&done) {
+        if (n == 0) return;
+#if BPTREE_HAS_URING
+        if (ring_ok) {
+          ring.read_all(reqs, n, done);
+          return;
+        }
+#endif
+        if (pool == nullptr) pool = new Read_Pool(workers);
+        pool->read_all(reqs, n, done);
+      }
+    };
+
+}
+
+#endif //BPTREE_ASYNCIO_H
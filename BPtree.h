@@ -12,11 +12,12 @@
 #include "BNode.h"
 #include "utility.h"
 #include "Buffer.h"
+#include "Page.h"
 
 namespace arima_kana {
-    template<class K, class V, size_t degree, size_t min_size>
+    template<class K, class V, size_t degree, size_t min_size, class Layout = aos_layout, size_t page = 0>
     class BPTree {
-      typedef BNode<K, V, degree> Node;
+      typedef paged<BNode<K, V, degree, Layout>, page> Node;
       typedef pair<K, V> p;
 
       size_t vacant_pos() {
@@ -33,277 +34,208 @@ namespace arima_kana {
         return ++size;
       }
 
+      /// @step
+      /// one level of a root-to-leaf path:
+      /// the node and the slot followed (or touched) in it
+      struct step {
+        size_t pos;
+        size_t slot;
+      };
+
+      /// levels are indexed from the root, the last one is the leaf
+      typedef arima_kana::vector<step, allocator<step>, 16> path;
+
       /// @divide_node
-      /// divide the node at pos, with
-      /// the first half in the new node
-      void divide_node(size_t pos) {
+      /// divide the node at level of the path, with
+      /// the first half in the new node;
+      /// only the node, the new node and the parent are touched
+      void divide_node(const path &pth, size_t level) {
+        size_t pos = pth[level].pos;
         size_t new_pos = vacant_pos();
         Node &node = list[pos], &new_node = list[new_pos];
         size_t mid = node._size / 2;
         for (size_t i = 0; i < mid; ++i) {
-          new_node._key[i] = node._key[i];
+          new_node._key.assign(i, node._key, i);
           new_node._chil[i] = node._chil[i];
         }
         for (size_t i = mid; i < node._size; ++i) {
-          node._key[i - mid] = node._key[i];
+          node._key.move(i - mid, i);
           node._chil[i - mid] = node._chil[i];
         }
         new_node.is_leaf = node.is_leaf;
-        new_node._par = node._par;
         new_node._size = mid;
         node._size -= mid;
-        if (!node.is_leaf) {
-          for (size_t i = 0; i < new_node._size; ++i) {
-            list[new_node._chil[i]]._par = new_pos;
-          }
-        }
-        if (node._par == 0) {
+        if (level == 0) {
           size_t new_root_pos = vacant_pos();
           Node &root_node = list[new_root_pos];
           root_node._size = 2;
-          root_node._key[1] = node._key[node._size - 1];
+          root_node._key.set(1, node.max_key());
           root_node._chil[1] = pos;
-          root_node._key[0] = new_node._key[new_node._size - 1];
+          root_node._key.set(0, new_node.max_key());
           root_node._chil[0] = new_pos;
           root_node.is_leaf = false;
-          new_node._par = new_root_pos, node._par = new_root_pos;
           root = new_root_pos;
         } else {
-          Node &par_node = list[node._par];
-          par_node.insert_pair(new_node._key[new_node._size - 1].first,
-                               new_node._key[new_node._size - 1].second, new_pos);
+          Node &par_node = list[pth[level - 1].pos];
+          p new_max = new_node.max_key();
+          par_node.insert_pair(new_max.first, new_max.second, new_pos);
           if (par_node._size == degree) {
-            divide_node(node._par);
+            divide_node(pth, level - 1);
           }
         }
       }
 
-      /// @insert_max_adjust
-      /// if kv is greater than all elements in the tree,
-      /// adjust the maximum in the tree nodes to kv
-      /// (no leaf node is adjusted)
-      void insert_max_adjust(const p &kv) {
+      /// @descend
+      /// records the path to the leaf whose range holds kv;
+      /// with raise, a kv greater than every pair first raises
+      /// the maximum separators of the inner nodes to it,
+      /// otherwise such a kv leaves the path empty
+      void descend(const p &kv, path &pth, bool raise) {
+        pth.clear();
+        if (root == 0) return;
+        ++descents;
         size_t pos = root;
-        while (!list[pos].is_leaf) {
-          list[pos]._key[list[pos]._size - 1] = kv;
-          pos = list[pos]._chil[list[pos]._size - 1];
-        }
-      }
-
-      /// @subs substitute old_kv with new_kv in the node
-      /// and recursively substitute the maximum in the parent nodes
-      /// if the maximum is the old_kv
-      void subs(size_t pos, const p &old_kv, const p &new_kv) {
-        Node &node = list[pos];
-        size_t i = node.lower_bound(old_kv);
-        /// first element that >= old_kv
-//        while (i < node._size && node._key[i] < old_kv) ++i;///binary search
-        if (node._key[i] != old_kv) {
-          error("Key-value pair not found");
-        }
-        node._key[i] = new_kv;
-        if (i == node._size - 1 && node._par != 0) {
-          subs(node._par, old_kv, new_kv);
+        while (true) {
+          const Node &node = list.get(pos);
+          size_t i = node.lower_bound(kv);
+          if (node.is_leaf) {
+            pth.push_back({pos, i});
+            return;
+          }
+          if (i == node._size) {
+            if (!raise) {
+              pth.clear();
+              return;
+            }
+            list[pos]._key.set(--i, kv);
+          }
+          pth.push_back({pos, i});
+          pos = node._chil[i];
         }
       }
 
-
       /// @list_lower_bound
       /// returns the position of the last node
       /// whose first element is no greater than kv,
       /// in the leaf node layer
       size_t list_lower_bound(const p &kv) {
+        if (root == 0) return 0;
+        ++descents;
         size_t pos = root;
-        Node *node = &list[pos];
+        const Node *node = &list.get(pos);
         while (!node->is_leaf) {
           size_t i = node->lower_bound(kv);
           if (i == node->_size) return 0;
           pos = node->_chil[i];
-          node = &list[pos];
+          node = &list.get(pos);
         }
         return pos;
       }
 
-      size_t lower_bound(const K &k) {
-        if (root == 0) return 0;
-        size_t pos = root;
-        Node *node = &list[pos];
-        while (!node->is_leaf) {
-          size_t i = node->lower_bound(k);
-          if (i == node->_size) --i;
-          pos = node->_chil[i];
-          node = &list[pos];
-        }
-        return pos;
+      /// @next_leaf
+      /// moves the path to the leaf after its current one,
+      /// false if it is the last
+      bool next_leaf(path &pth) {
+        size_t level = pth.size() - 1;
+        while (level > 0 && pth[level - 1].slot + 1 == list.get(pth[level - 1].pos)._size) --level;
+        if (level == 0) return false;
+        size_t pos = list.get(pth[level - 1].pos)._chil[++pth[level - 1].slot];
+        for (; level < pth.size(); ++level) {
+          pth[level] = {pos, 0};
+          if (level + 1 < pth.size()) pos = list.get(pos)._chil[0];
+        }
+        return true;
       }
 
-      size_t upper_bound(const K &k) {
-        if (root == 0) return 0;
-        size_t pos = root;
-        Node *node = &list[pos];
-        while (!node->is_leaf) {
-          size_t i = node->upper_bound(k);
-          if (i == node->_size) --i;
-          pos = node->_chil[i];
-          node = &list[pos];
-        }
-        return pos;
-      }
-
-      size_t next_sibling(size_t pos) {
-        if (list[pos]._par == 0) return 0;
-        size_t par = list[pos]._par;
-//        size_t i = list[par]._size - 1;
-        size_t i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//        while (i > 0 && list[par]._chil[i] != pos) --i;///binary search
-        int cnt = 0;
-        while (i == list[par]._size - 1) {
-          pos = list[pos]._par;
-          ++cnt;
-          if (list[par]._par == 0) return 0;// no next sibling
-          par = list[par]._par;
-          i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//          while (i > 0 && list[par]._chil[i] != pos) --i;///binary search
-        }
-        ++i;
-        pos = list[par]._chil[i];
-        while (cnt--) {
-          pos = list[pos]._chil[0];
-        }
-        return pos;
-      }
-
-      size_t prev_sibling(size_t pos) {
-        if (list[pos]._par == 0) return 0;
-        size_t par = list[pos]._par;
-        size_t i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//        while (i < list[par]._size - 1 && list[par]._chil[i] != pos) ++i;///binary search
-        int cnt = 0;
-        while (i == 0) {
-          pos = list[pos]._par;
-          ++cnt;
-          if (list[par]._par == 0) return 0;// no next sibling
-          par = list[par]._par;
-          i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//          while (i < list[par]._size - 1 && list[par]._chil[i] != pos) ++i;///binary search
-        }
-        --i;
-        pos = list[par]._chil[i];
-        while (cnt--) {
-          pos = list[pos]._chil[list[pos]._size - 1];
-        }
-        return pos;
-      }
-
-      /// @next_sp_sibling
-      /// returns the next sibling in the same parent node
-      size_t next_sp_sibling(size_t pos) {
-        if (list[pos]._par == 0) return 0;
-        size_t par = list[pos]._par;
-        size_t i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//        while (i > 0 && list[par]._chil[i] != pos) --i;///binary search
-        if (i == list[par]._size - 1) {
-          return 0;
+      /// @rebalance
+      /// the node at level of the path has underflowed,
+      /// borrow from or merge with a sibling in the same parent
+      void rebalance(const path &pth, size_t level) {
+        size_t pos = pth[level].pos;
+        size_t par = pth[level - 1].pos, s = pth[level - 1].slot;
+        size_t l = s > 0 ? list[par]._chil[s - 1] : 0;
+        size_t r = s + 1 < list[par]._size ? list[par]._chil[s + 1] : 0;
+        if (l != 0) {
+          if (list[l]._size > min_size) borrow_from_left(l, pos, par);
+          else merge(l, pos, par);
+        } else if (r != 0) {
+          if (list[r]._size > min_size) borrow_from_right(pos, r, par);
+          else merge(pos, r, par);
+        } else {
+          return;
         }
-        ++i;
-        pos = list[par]._chil[i];
-        return pos;
-      }
-
-      /// @prev_sp_sibling
-      /// returns the previous sibling in the same parent node
-      size_t prev_sp_sibling(size_t pos) {
-        if (list[pos]._par == 0) return 0;
-        size_t par = list[pos]._par;
-        size_t i = list[par].lower_bound(list[pos]._key[list[pos]._size - 1]);
-//        while (i < list[par]._size - 1 && list[par]._chil[i] != pos) ++i;///binary search
-        if (i == 0) {
-          return 0;
+        if (list[par]._size >= min_size) return;
+        if (level - 1 == 0) {
+          if (list[par]._size == 1) {
+            list[par]._size = 0;
+            root = list[par]._chil[0];
+          }
+        } else {
+          rebalance(pth, level - 1);
         }
-        --i;
-        pos = list[par]._chil[i];
-        return pos;
       }
 
-      void merge(size_t l, size_t r) {
-        size_t par = list[l]._par;
+      /// @merge moves l into its right sibling r under par
+      void merge(size_t l, size_t r, size_t par) {
         for (int j = list[r]._size - 1; j >= 0; j--) {
-          list[r]._key[j + list[l]._size] = list[r]._key[j];
+          list[r]._key.move(j + list[l]._size, j);
           list[r]._chil[j + list[l]._size] = list[r]._chil[j];
         }
         for (int j = 0; j < list[l]._size; j++) {
-          list[r]._key[j] = list[l]._key[j];
+          list[r]._key.assign(j, list[l]._key, j);
           list[r]._chil[j] = list[l]._chil[j];
-          if (!list[r].is_leaf) list[list[r]._chil[j]]._par = r;
         }
-        list[par].remove_pair(list[l]._key[list[l]._size - 1].first, list[l]._key[list[l]._size - 1].second);
+        p l_max = list[l].max_key();
+        list[par].remove_pair(l_max.first, l_max.second);
         list[r]._size += list[l]._size;
         list[l]._size = 0;
 //        free_pos.push_back(l);
-        if (list[par]._size < min_size) {
-          if (list[par]._par == 0) {
-            if (list[par]._size == 1) {
-              list[par]._size = 0;
-              root = list[par]._chil[0];
-              list[root]._par = 0;
-//              free_pos.push_back(par);
-            }
-          } else {
-            l = prev_sp_sibling(par), r = next_sp_sibling(par);
-            if (l != 0) {
-              if (list[l]._size > min_size) borrow_from_left(l, par);
-              else merge(l, par);
-            } else if (r != 0) {
-              if (list[r]._size > min_size) borrow_from_right(par, r);
-              else merge(par, r);
-            }
-          }
-        }
       }
 
-      void borrow_from_left(size_t l, size_t r) {
-        size_t par = list[l]._par;
+      void borrow_from_left(size_t l, size_t r, size_t par) {
         size_t bor_num = (list[l]._size - list[r]._size) / 2;
         size_t bor_st = list[l]._size - bor_num;
         for (int j = list[r]._size - 1; j >= 0; j--) {
-          list[r]._key[j + bor_num] = list[r]._key[j];
+          list[r]._key.move(j + bor_num, j);
           list[r]._chil[j + bor_num] = list[r]._chil[j];
         }
         for (int j = 0; j < bor_num; j++) {
-          list[r]._key[j] = list[l]._key[j + bor_st];
+          list[r]._key.assign(j, list[l]._key, j + bor_st);
           list[r]._chil[j] = list[l]._chil[j + bor_st];
-          if (!list[r].is_leaf) list[list[r]._chil[j]]._par = r;
         }
         list[l]._size -= bor_num;
         list[r]._size += bor_num;
-        list[par].modify_pair(list[r]._key[bor_num - 1], list[l]._key[list[l]._size - 1]);
+        list[par].modify_pair(list[r]._key.get(bor_num - 1), list[l].max_key());
       }
 
-      void borrow_from_right(size_t l, size_t r) {
-        size_t par = list[l]._par;
+      void borrow_from_right(size_t l, size_t r, size_t par) {
         size_t bor_num = (list[r]._size - list[l]._size) / 2;
         for (int j = 0; j < bor_num; j++) {
-          list[l]._key[list[l]._size + j] = list[r]._key[j];
+          list[l]._key.assign(list[l]._size + j, list[r]._key, j);
           list[l]._chil[list[l]._size + j] = list[r]._chil[j];
-          if (!list[l].is_leaf) list[list[r]._chil[j]]._par = l;
         }
         for (int j = 0; j < list[r]._size - bor_num; j++) {
-          list[r]._key[j] = list[r]._key[j + bor_num];
+          list[r]._key.move(j, j + bor_num);
           list[r]._chil[j] = list[r]._chil[j + bor_num];
         }
         list[r]._size -= bor_num;
         list[l]._size += bor_num;
-        list[par].modify_pair(list[l]._key[list[l]._size - bor_num - 1], list[l]._key[list[l]._size - 1]);
+        list[par].modify_pair(list[l]._key.get(list[l]._size - bor_num - 1), list[l].max_key());
       }
 
     public:
 
+      /// block ids returned by find, the first 16 are kept inline
+      typedef arima_kana::vector<size_t, allocator<size_t>, 16> block_list;
+
       static constexpr size_t SIZE_T = sizeof(size_t);
       static constexpr size_t SIZE_NODE = sizeof(Node);
+      static constexpr size_t SIZE_HEADER = page_header<Node>(3);
 
       size_t size = 0;
       size_t root = 0;// 0 means empty
       size_t free_num = 0;
+      size_t descents = 0;// root-to-leaf walks, for profiling
       std::fstream index_filer;
       std::string index_file;
       List_Map_Buffer<Node, size_t, 3, 10000> list;
@@ -322,13 +254,11 @@ namespace arima_kana {
         }
       }
 
-      /// the following 3 functions are used to modify list
+      /// the following 3 functions are used to modify list;
+      /// the header goes through the node buffer, see Buffer::write_header
       void init_list() {
-        index_filer.open(index_file, std::ios::out);
-        index_filer.write(reinterpret_cast<char *>(&size), SIZE_T);
-        index_filer.write(reinterpret_cast<char *>(&root), SIZE_T);
-        index_filer.write(reinterpret_cast<char *>(&free_num), SIZE_T);
-        index_filer.close();
+        size_t header[3] = {size, root, free_num};
+        list.write_header(header, true);
       }
 
       void read_list() {
@@ -351,39 +281,31 @@ namespace arima_kana {
         index_filer.close();
       }
 
-      void write_node(const Node &n, size_t pos) {
-        index_filer.open(index_file, std::ios::in | std::ios::out | std::ios::binary);
-        index_filer.seekp(SIZE_T * 3 + (pos - 1) * SIZE_NODE);
-        index_filer.write(reinterpret_cast<const char *>(&n), SIZE_NODE);
-        index_filer.close();
+      void write_node(Node &n, size_t pos) {
+        list.write_node(n, pos);
       }
 
       void append_node(const Node &n) {
-        index_filer.open(index_file, std::ios::app | std::ios::binary);
-        index_filer.write(reinterpret_cast<const char *>(&n), SIZE_NODE);
-        index_filer.close();
+        list.append_node(n);
       }
 
       void write_list() {
-        index_filer.open(index_file, std::ios::in | std::ios::out | std::ios::binary);
 //        free_num = free_pos.size();
-        index_filer.write(reinterpret_cast<char *>(&size), SIZE_T);
-        index_filer.write(reinterpret_cast<char *>(&root), SIZE_T);
-        index_filer.write(reinterpret_cast<char *>(&free_num), SIZE_T);
+        size_t header[3] = {size, root, free_num};
+        list.write_header(header);
 //        for (int i = 1; i < list.size(); i++) {
 //          index_filer.write(reinterpret_cast<char *>(&list[i]), SIZE_NODE);
 //        }
 //        for (int i = 0; i < free_num; i++) {
 //          index_filer.write(reinterpret_cast<char *>(&free_pos[i]), SIZE_T);
 //        }
-        index_filer.close();
       }
 
       void insert(const K &k, const V &v, size_t val) {
         if (root == 0) {
           Node tmp;
           tmp._size = 1;
-          tmp._key[0] = p(k, v);
+          tmp._key.set(0, p(k, v));
           tmp._chil[0] = val;
           tmp.is_leaf = true;
           root = 1;
@@ -392,47 +314,45 @@ namespace arima_kana {
           return;
         }
         auto kv = p(k, v);
-        size_t pos = list_lower_bound(kv);
-        if (pos == 0) {
-          insert_max_adjust(kv);
-          pos = list_lower_bound(kv);
-        }
-
-        Node &node = list[pos];
+        path pth;
+        descend(kv, pth, true);
+        Node &node = list[pth[pth.size() - 1].pos];
         try { node.insert_pair(k, v, val); }
         catch (...) {
           return;
         }
         if (node._size == degree) {
-          divide_node(pos);
+          divide_node(pth, pth.size() - 1);
         }
       }
 
       void remove(const K &k, const V &v) {
         auto kv = p(k, v);
-        size_t pos = list_lower_bound(kv);
-        if (pos == 0 || list[pos]._size == 0) {
+        path pth;
+        descend(kv, pth, false);
+        if (pth.size() == 0 || list.get(pth[pth.size() - 1].pos)._size == 0) {
           //error("Key-value pair not found");
           return;
         }
-        Node &node = list[pos];
-        if (kv == node._key[node._size - 1] && node._par != 0)
-          subs(node._par, node._key[node._size - 1], node._key[node._size - 2]);
+        size_t level = pth.size() - 1;
+        Node &node = list[pth[level].pos];
+        if (level > 0 && slot_equal(node._key, node._size - 1, kv)) {
+          // the separators of the leaf's maximum follow it down
+          p new_max = node._key.get(node._size - 2);
+          for (size_t l = level; l-- > 0;) {
+            Node &par = list[pth[l].pos];
+            par._key.set(pth[l].slot, new_max);
+            if (pth[l].slot + 1 != par._size) break;
+          }
+        }
         try { node.remove_pair(k, v); }
         catch (...) {
           return;
         }
-        if (node._size < min_size) {
-          size_t l = prev_sp_sibling(pos), r = next_sp_sibling(pos);
-          if (l != 0) {
-            if (list[l]._size > min_size) borrow_from_left(l, pos);
-            else merge(l, pos);
-          } else if (r != 0) {
-            if (list[r]._size > min_size) borrow_from_right(pos, r);
-            else merge(pos, r);
-          }
+        if (level > 0 && node._size < min_size) {
+          rebalance(pth, level);
         }
-        if (list[root]._size == 0) {
+        if (list.get(root)._size == 0) {
           clear();
         }
       }
@@ -445,42 +365,131 @@ namespace arima_kana {
       size_t block_lower_bound(const p &kv) {
         size_t pos = list_lower_bound(kv);
         if (pos == 0) return 0;
-        Node &node = list[pos];
+        const Node &node = list.get(pos);
         size_t i = node._size;
-        while (i > 0 && !(node._key[i - 1] < kv)) --i;
+        while (i > 0 && !slot_less(node._key, i - 1, kv)) --i;
         return node._chil[i];
       }
 
       /// @adjust_max
       /// adjust the maximum pair to kv
       void adjust_max(const p &kv) {
+        ++descents;
         size_t pos = root;
         while (!list[pos].is_leaf) {
-          list[pos]._key[list[pos]._size - 1] = kv;
+          list[pos]._key.set(list[pos]._size - 1, kv);
           pos = list[pos]._chil[list[pos]._size - 1];
         }
-        list[pos]._key[list[pos]._size - 1] = kv;
+        list[pos]._key.set(list[pos]._size - 1, kv);
+      }
+
+      /// @route
+      /// the block kv belongs to, i.e. the first one whose maximum is no less than kv;
+      /// if kv is greater than every pair, the maximum separators
+      /// are raised to kv on the way down and the last block is returned.
+      /// One descent, 0 if the tree is empty.
+      size_t route(const p &kv) {
+        if (root == 0) return 0;
+        ++descents;
+        size_t pos = root;
+        while (true) {
+          const Node &node = list.get(pos);
+          size_t i = node.lower_bound(kv);
+          if (i == node._size) list[pos]._key.set(--i, kv);
+          if (node.is_leaf) return node._chil[i];
+          pos = node._chil[i];
+        }
+      }
+
+      /// @replace_max
+      /// the maximum of a block changes from old_kv to new_kv,
+      /// which must still be greater than every pair of the blocks before it;
+      /// every separator equal to old_kv is updated in place in one descent
+      void replace_max(const p &old_kv, const p &new_kv) {
+        if (root == 0) return;
+        ++descents;
+        size_t pos = root;
+        while (true) {
+          const Node &node = list.get(pos);
+          size_t i = node.lower_bound(old_kv);
+          if (i == node._size) return;
+          if (slot_equal(node._key, i, old_kv)) list[pos]._key.set(i, new_kv);
+          if (node.is_leaf) return;
+          pos = node._chil[i];
+        }
+      }
+
+      /// @for_each_block
+      /// calls fn(block) for every block that may hold k, in order,
+      /// without collecting them; fn may return false to stop.
+      /// fn must not modify the tree.
+      template<class F>
+      void for_each_block(const K &k, F &&fn) {
+        if (root == 0) return;
+        ++descents;
+        path pth;
+        size_t pos = root;
+        while (true) {
+          const Node &node = list.get(pos);
+          size_t i = node.lower_bound(k);
+          if (i == node._size) --i;
+          pth.push_back({pos, i});
+          if (node.is_leaf) break;
+          pos = node._chil[i];
+        }
+        while (true) {
+          const Node &node = list.get(pth[pth.size() - 1].pos);
+          size_t hi = node.upper_bound(k);
+          for (size_t i = node.lower_bound(k); i <= hi && i < node._size; i++) {
+            if (!visit(fn, node._chil[i])) return;
+          }
+          if (hi < node._size || !next_leaf(pth)) return;
+        }
       }
 
       /// @find
       /// returns the possible position of the key-value pair
       /// i.e. the position of the last node
       /// such that kv >= node._key[0]
-      arima_kana::vector<size_t> find(const K &k) {
-        arima_kana::vector<size_t> res;
-        size_t pos = lower_bound(k);
-        size_t fini = upper_bound(k);
-        size_t next;
-        while (pos != 0) {
-          Node &node = list[pos];
-          for (int i = list[pos].lower_bound(k); i <= list[pos].upper_bound(k) && i < list[pos]._size; i++) {
-            res.push_back(node._chil[i]);
+      block_list find(const K &k) {
+        block_list res;
+        for_each_block(k, [&res](size_t block) { res.push_back(block); });
+        return res;
+      }
+
+      /// @build
+      /// replaces the tree by one over n blocks, entry(i) giving
+      /// the (maximum, block) of the i-th in ascending order.
+      /// Levels are packed bottom-up, 3/4 full so that inserts
+      /// do not split at once; every node but a lone root keeps min_size entries
+      template<class F>
+      void build(size_t n, F &&entry) {
+        clear();
+        if (n == 0) return;
+        typedef pair<p, size_t> slot;
+        static constexpr size_t per = degree * 3 / 4;
+        vector<slot> level, up;
+        for (size_t i = 0; i < n; ++i) level.push_back(entry(i));
+        for (bool leaf = true; true; leaf = false) {
+          size_t m = (level.size() + per - 1) / per, at = 0;
+          up.clear();
+          for (size_t j = 0; j < m; ++j) {
+            Node node;
+            node.is_leaf = leaf;
+            node._size = level.size() / m + (j < level.size() % m);
+            for (size_t i = 0; i < node._size; ++i, ++at) {
+              node._key.set(i, level[at].first);
+              node._chil[i] = level[at].second;
+            }
+            append_node(node);
+            up.push_back(slot(node.max_key(), ++size));
           }
-          next = next_sibling(pos);
-          if (pos == fini) break;
-          pos = next;
+          if (m == 1) break;
+          level.clear();
+          for (size_t i = 0; i < up.size(); ++i) level.push_back(up[i]);
         }
-        return res;
+        root = size;
+        write_list();
       }
 
       void clear() {
@@ -489,8 +498,6 @@ namespace arima_kana {
 //        free_pos.clear();
         free_num = 0;
         list.clear();
-        index_filer.open(index_file, std::ios::out);
-        index_filer.close();
         init_list();
       }
 
@@ -502,11 +509,10 @@ namespace arima_kana {
       void print() {
         std::cout << "root=" << root << '\n';
         for (int i = 1; i <= size; i++) {
-          Node &node = list[i];
-          std::cout << i << (root == i ? ": root" : (node.is_leaf ? ": leaf" : ": branch")) << '\n' << node._par
-                    << '\n';
+          const Node &node = list.get(i);
+          std::cout << i << (root == i ? ": root" : (node.is_leaf ? ": leaf" : ": branch")) << '\n';
           for (int j = 0; j < node._size; j++) {
-            std::cout << node._key[j];
+            std::cout << node._key.get(j);
           }
           std::cout << '\n';
           for (int j = 0; j < node._size; j++) {
@@ -517,12 +523,12 @@ namespace arima_kana {
       }
 
       void map_print(size_t pos) {
-        if (!list[pos].is_leaf) {
-          for (int i = 0; i < list[pos]._size; i++) {
-            map_print(list[pos]._chil[i]);
+        if (!list.get(pos).is_leaf) {
+          for (int i = 0; i < list.get(pos)._size; i++) {
+            map_print(list.get(pos)._chil[i]);
           }
         } else {
-          list[pos].print();
+          list.get(pos).print();
         }
       }
 
@@ -3,53 +3,101 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <cmath>
 #include <filesystem>
 #include <utility>
+#include <memory>
 #include "error.h"
 #include "BPtree.h"
 #include "DataNode.h"
 #include "Buffer.h"
+#include "Page.h"
+#include "Bloom.h"
+#include "HashIndex.h"
+#include "AsyncIO.h"
 
 namespace arima_kana {
-    template<class K, class V, size_t block>
+    /// node capacities are derived from page_bytes, the page size in bytes
+    /// (see page_sizing), no longer from a block entry count;
+    /// with compress, data blocks are stored compressed (see Compressed_Buffer);
+    /// bloom_bits > 0 keeps a Bloom filter of that many bits per block (see Block_Bloom);
+    /// with hash_index, exact lookups find their blocks through a Hash_Index
+    /// instead of descending the tree
+    template<class K, class V, size_t page_bytes = 4096, class Layout = aos_layout, bool compress = false,
+            size_t bloom_bits = 0, bool hash_index = false>
     class BlockRiver {
     public:
+      static constexpr size_t MIN_PAGE = 4096;// one device page
+      static_assert(page_bytes >= MIN_PAGE && (page_bytes & (page_bytes - 1)) == 0,
+                    "page_bytes is the page size in bytes (a power of 2, at least 4096), not the block entry count");
+
+      typedef page_sizing<K, V, page_bytes, Layout> sizing;
+      static constexpr size_t block = sizing::block;
+      static constexpr bool compressed = compress;
+      static constexpr size_t CACHE = 1800;// data blocks kept in memory
+      static constexpr size_t PREFETCH = 8;// default read-ahead depth, see prefetch_blocks
 
       typedef pair<K, V> KV;
-      typedef DataNode<K, V, block> DNode;
-      typedef BPTree<K, V, 70, 20> map;
-      typedef List_Map_Buffer<DNode, size_t, 1, 1800> buffer;
+      typedef paged<DataNode<K, V, block, Layout>, page_bytes> DNode;
+      typedef BPTree<K, V, sizing::degree, sizing::min_size, Layout, page_bytes> map;
+      typedef std::conditional_t<compress,
+              Compressed_Buffer<DNode, size_t, 1, CACHE>,
+              List_Map_Buffer<DNode, size_t, 1, CACHE>> buffer;
 
       static constexpr int SIZE_DNODE = sizeof(DNode);
       static constexpr int SIZE_T = sizeof(size_t);
+      static constexpr size_t SIZE_HEADER = page_header<DNode>(1);
 
       size_t block_num = 0;
       std::fstream data_filer;
       std::string data_file;
       map list;
       buffer data_list;
+      Block_Bloom<K, bloom_bits, block> bloom;
+      Hash_Index<K, page_bytes, hash_index> index;
+      std::unique_ptr<Async_Reader> io;// created by the first find_batch
 
       explicit BlockRiver(const std::string &df) :
               data_file(df),
               list(df),
-              data_list(df) {
+              data_list(df),
+              bloom(df + "_bloom"),
+              index(df) {
+        if constexpr (!compress) data_list.prefetch_depth = PREFETCH;
         data_filer.open(data_file, std::ios::in);
         if (!data_filer.is_open()) {
           data_filer.close();
+          data_list.clear();
+          bloom.clear();
+          index.clear();
           init_data();
         } else {
           data_filer.close();
           read_data();
+          // side files that are missing or out of step with the data are rebuilt from it
+          bool bloom_ok = bloom.covers(block_num), index_ok = index.loaded(block_num);
+          if (!bloom_ok) bloom.clear();
+          if (!index_ok) index.clear();
+          if (!bloom_ok || !index_ok) {
+            for (size_t b = 1; b <= block_num; ++b) {
+              const DNode &t = data_list.get(b);
+              if (!bloom_ok) bloom.rebuild(b, t);
+              if (!index_ok) index.add_block(b, t);
+            }
+          }
+          index.blocks = block_num;
         }
       }
 
+      /// the header and the blocks are written through data_list,
+      /// so that in direct mode nothing reaches the file buffered;
+      /// the hash index records the block count with its directory
       void write_data() {
-        data_filer.open(data_file, std::ios::in | std::ios::out | std::ios::binary);
-        data_filer.write(reinterpret_cast<char *>(&block_num), SIZE_T);
-        data_filer.close();
+        data_list.write_header(&block_num);
+        index.blocks = block_num;
       }
 
       ~BlockRiver() {
@@ -58,9 +106,7 @@ namespace arima_kana {
       }
 
       void init_data() {
-        data_filer.open(data_file, std::ios::out | std::ios::binary);
-        data_filer.write(reinterpret_cast<char *>(&block_num), SIZE_T);
-        data_filer.close();
+        data_list.write_header(&block_num, true);
       }
 
       void read_data() {
@@ -69,25 +115,23 @@ namespace arima_kana {
         data_filer.close();
       }
 
+      /// @append_main
+      /// the new block only lives in the buffer
+      /// until it is evicted or flushed
       void append_main(DNode &t) {
-        data_filer.open(data_file, std::ios::app);
-        data_filer.write(reinterpret_cast<char *>(&t), SIZE_DNODE);
-        data_filer.close();
         ++block_num;
+        data_list[block_num] = t;
       }
 
       void write_main(DNode &t, const int pos) {
         if (pos > block_num) return;
-        data_filer.open(data_file, std::ios::out | std::ios::in | std::ios::binary);
-        data_filer.seekp(sizeof(block_num) + (pos - 1) * SIZE_DNODE);
-        data_filer.write(reinterpret_cast<char *> (&t), SIZE_DNODE);
-        data_filer.close();
+        data_list.write_node(t, pos);
       }
 
       void read_main(DNode &t, const int pos) {
         if (pos > block_num) return;
         data_filer.open(data_file, std::ios::in | std::ios::binary);
-        data_filer.seekg(sizeof(block_num) + (pos - 1) * SIZE_DNODE);
+        data_filer.seekg(page_offset<DNode>(1, pos));
         data_filer.read(reinterpret_cast<char *> (&t), SIZE_DNODE);
         data_filer.close();
       }
@@ -100,34 +144,27 @@ namespace arima_kana {
           DNode tmp(kv);
           append_main(tmp);
           list.insert(k, v, block_num);
-          data_list[block_num] = tmp;
+          bloom.add(block_num, k);
+          index.add(hash(k), block_num);
           return;
         }
-        size_t it = list.block_lower_bound(kv);
-
-        if (it == 0) {
-          list.adjust_max(kv);
-          // adjust the maximum to kv
-          it = list.block_lower_bound(kv);
-          // it points to a min node
-        }// kv is greater than the maximum
+        // raises the maximum to kv if kv is greater than it
+        size_t it = list.route(kv);
         DNode &tmp = data_list[it];
         try { tmp.insert_pair(k, v); }
         catch (...) { return; }
+        bloom.add(it, k);
+        index.add(hash(k), it);
         if (tmp.size >= block) {
           DNode new_node;
-          new_node.size = tmp.size / 2;
-          for (int i = 0; i < tmp.size / 2; i++) {
-            new_node._data[i] = tmp._data[i];
-          }
-          for (int i = tmp.size / 2; i < tmp.size; i++) {
-            tmp._data[i - tmp.size / 2] = tmp._data[i];
-          }
-          tmp.size -= tmp.size / 2;
-          list.insert(new_node._data[new_node.size - 1].first, new_node._data[new_node.size - 1].second, block_num + 1);
+          tmp.split(new_node);
+          bloom.rebuild(it, tmp);
+          bloom.rebuild(block_num + 1, new_node);
+          index.move_block(it, block_num + 1, new_node);
+          KV new_max = new_node.max_pair();
+          list.insert(new_max.first, new_max.second, block_num + 1);
           //std::cout << new_node.first.key << new_node.first.pos << block_num + 1 << '\n';
           append_main(new_node);
-          data_list[block_num] = new_node;
         }
       }
 
@@ -137,33 +174,219 @@ namespace arima_kana {
         if (it == 0) return;
         DNode &tmp = data_list[it];
 
-        if (kv == tmp._data[tmp.size - 1]) {
-          list.remove(k, v);
-          if (tmp.size != 1) {
-            list.insert(tmp._data[tmp.size - 2].first, tmp._data[tmp.size - 2].second, it);
-          }
+        if (tmp.size != 0 && slot_equal(tmp._data, tmp.size - 1, kv)) {
+          if (tmp.size == 1) list.remove(k, v);
+          else list.replace_max(kv, tmp._data.get(tmp.size - 2));
         }
         try { tmp.remove_pair(k, v); }
         catch (...) { return; }
+        index.remove(hash(k), it);
+      }
+
+      /// @for_each
+      /// hands every value of k to fn in ascending order,
+      /// straight from the data blocks and without allocating;
+      /// fn may return false to stop early.
+      /// Returns the number of values visited.
+      template<class F>
+      size_t for_each(const K &k, F &&fn) {
+        uint8_t fp = DNode::fingerprint(k);
+        size_t cnt = 0;
+        bool go = true;
+        if constexpr (decltype(index)::ENABLED) {
+          for_each_indexed(k, fp, [&](const DNode &t, size_t j) {
+            for (; go && t.match(j, k, fp); ++j) {
+              ++cnt;
+              go = visit(fn, static_cast<const V &>(t._data.value(j)));
+            }
+            return go;
+          });
+          return cnt;
+        }
+        typename map::block_list ids;
+        list.for_each_block(k, [&](size_t id) {
+          if (bloom.may_contain(id, k)) ids.push_back(id);
+        });
+        if (ids.size() > 1) prefetch_blocks(ids);
+        for (size_t i = 0; go && i < ids.size(); ++i) {
+          const DNode &t = data_list.get(ids[i]);
+          for (size_t j = t.find_first(k, fp); go && t.match(j, k, fp); ++j) {
+            ++cnt;
+            go = visit(fn, static_cast<const V &>(t._data.value(j)));
+          }
+        }
+        return cnt;
+      }
+
+      /// @prefetch_blocks
+      /// reads the uncached blocks among ids that form runs of adjacent ids
+      /// (a split gives the new block the next id) with one read per run
+      /// of up to data_list.prefetch_depth blocks; lone blocks are left to demand
+      template<class List>
+      void prefetch_blocks(const List &ids) {
+        if constexpr (!compress) {
+          if (data_list.prefetch_depth < 2) return;
+          vector<size_t, allocator<size_t>, 16> cold;
+          for (size_t i = 0; i < ids.size(); ++i) {
+            if (!data_list.cached(ids[i])) cold.push_back(ids[i]);
+          }
+          if (cold.size() < 2) return;
+          std::sort(&cold[0], &cold[0] + cold.size());
+          for (size_t i = 0; i < cold.size();) {
+            size_t j = i + 1;
+            while (j < cold.size() && cold[j] == cold[j - 1] + 1 && j - i < data_list.prefetch_depth) ++j;
+            if (j - i > 1) data_list.prefetch(cold[i], j - i);
+            i = j;
+          }
+        }
+      }
+
+      /// @for_each_indexed
+      /// calls fn(node, first match) for every block the hash index
+      /// names for k, ordered by the first value of k in the block
+      template<class F>
+      void for_each_indexed(const K &k, uint8_t fp, F &&fn) {
+        typedef pair<V, size_t> run;
+        vector<run, allocator<run>, 8> runs;
+        index.for_each_block(hash(k), [&](size_t id) {
+          const DNode &t = data_list.get(id);
+          size_t j = t.find_first(k, fp);
+          if (t.match(j, k, fp)) runs.push_back(run(t._data.value(j), id));
+        });
+        for (size_t i = 1; i < runs.size(); ++i) {
+          for (size_t j = i; j > 0 && runs[j].first < runs[j - 1].first; --j) std::swap(runs[j], runs[j - 1]);
+        }
+        for (size_t i = 0; i < runs.size(); ++i) {
+          const DNode &t = data_list.get(runs[i].second);
+          if (!fn(t, t.find_first(k, fp))) return;
+        }
+      }
+
+      /// @for_each_n
+      /// like for_each, but stops after the first n values
+      template<class F>
+      size_t for_each_n(const K &k, size_t n, F &&fn) {
+        if (n == 0) return 0;
+        size_t left = n;
+        return for_each(k, [&](const V &v) {
+          if (!visit(fn, v)) return false;
+          return --left != 0;
+        });
+      }
+
+      bool contains(const K &k) {
+        return for_each(k, [](const V &) { return false; }) != 0;
       }
 
       void find(const K &k, vector<V> &v) {
-        bool flag = false;
-        vector<size_t> tmp = list.find(k);
-        for (int i = 0; i < tmp.size(); i++) {
-          DNode &t = data_list[tmp[i]];
-          for (int j = 0; j < t.size; j++) {
-            if (t._data[j].first == k) {
-              v.push_back(t._data[j].second);
+        for_each(k, [&v](const V &val) { v.push_back(val); });
+      }
+
+      /// @adopt_blocks
+      /// takes over n blocks written straight to the data file
+      /// (see bulk_build) after a clear;
+      /// max_of(i) is the largest pair of block i + 1, ascending in i
+      template<class F>
+      void adopt_blocks(size_t n, F &&max_of) {
+        block_num = n;
+        write_data();
+        list.build(n, [&](size_t i) { return pair<KV, size_t>(max_of(i), i + 1); });
+        if constexpr (bloom_bits != 0 || hash_index) {
+          for (size_t b = 1; b <= n; ++b) {
+            const DNode &t = data_list.get(b);
+            bloom.rebuild(b, t);
+            index.add_block(b, t);
+          }
+        }
+      }
+
+      /// @for_each_candidate
+      /// calls fn(block) for every block that may hold k
+      template<class F>
+      void for_each_candidate(const K &k, F &&fn) {
+        if constexpr (decltype(index)::ENABLED) {
+          index.for_each_block(hash(k), fn);
+        } else {
+          list.for_each_block(k, [&](size_t id) {
+            if (bloom.may_contain(id, k)) fn(id);
+          });
+        }
+      }
+
+      /// @find_batch
+      /// appends the values of keys[i] to out[i] for i < n.
+      /// The keys are taken in windows: the blocks a window needs that are
+      /// not cached are read all at once through io (io_uring or a thread pool),
+      /// completing in any order, then the window is answered from the cache.
+      /// A block that cannot be read in full raises an error
+      void find_batch(const K *keys, size_t n, vector<V> *out) {
+        if constexpr (compress) {
+          for (size_t i = 0; i < n; ++i) find(keys[i], out[i]);
+          return;
+        } else {
+          static constexpr size_t window = CACHE / 2;
+          if (io == nullptr) io.reset(new Async_Reader());
+          vector<size_t> missing;
+          vector<read_req> reqs;
+          for (size_t i = 0; i < n;) {
+            size_t j = i;
+            missing.clear();
+            for (; j < n && missing.size() < window; ++j) {
+              for_each_candidate(keys[j], [&](size_t id) {
+                if (!data_list.cached(id)) missing.push_back(id);
+              });
             }
+            if (missing.size() > 0) {
+              std::sort(&missing[0], &missing[0] + missing.size());
+              size_t m = std::unique(&missing[0], &missing[0] + missing.size()) - &missing[0];
+              std::unique_ptr<DNode[]> frames(new DNode[m]);
+              int fd = ::open(data_file.c_str(), O_RDONLY | (data_list.direct() ? O_DIRECT : 0));
+              if (fd < 0) error("cannot open " + data_file);
+              reqs.clear();
+              for (size_t b = 0; b < m; ++b) {
+                reqs.push_back({fd, &frames[b], sizeof(DNode), buffer::offset(missing[b]), 0});
+              }
+              // a short read is raised only once no read into frames is in flight
+              bool failed = false;
+              io->read_all(&reqs[0], m, [&](size_t b) {
+                if (reqs[b].res != long(sizeof(DNode))) failed = true;
+                else data_list.install(missing[b], frames[b]);
+              });
+              ::close(fd);
+              if (failed) error("read failed: " + data_file);
+            }
+            for (; i < j; ++i) find(keys[i], out[i]);
           }
         }
       }
 
+      /// @use_direct
+      /// moves the data and index files to O_DIRECT (see Buffer::use_direct),
+      /// leaving their caching to data_list and the index buffer alone;
+      /// false if a file could not be moved (compressed blocks,
+      /// a file system without O_DIRECT)
+      bool use_direct() {
+        if constexpr (compress) return false;
+        else return data_list.use_direct() && list.list.use_direct();
+      }
+
+      /// @checkpoint
+      /// brings the files up to date without closing the river:
+      /// the headers, the cached index and data nodes
+      /// (see List_Map_Buffer::checkpoint), the Bloom filters and the hash index
+      void checkpoint() {
+        write_data();
+        list.write_list();
+        list.list.checkpoint();
+        data_list.checkpoint();
+        bloom.save();
+        index.checkpoint();
+      }
+
       void print() {
         list.print();
         for (int i = 1; i <= block_num; i++) {
-          DNode &tmp = data_list[i];
+          const DNode &tmp = data_list.get(i);
           std::cout << i << '\n';
           tmp.print();
         }
@@ -171,6 +394,9 @@ namespace arima_kana {
 
       void clear() {
         list.clear();
+        data_list.clear();
+        bloom.clear();
+        index.clear();
         block_num = 0;
         init_data();
       }
@@ -0,0 +1,168 @@
+#ifndef BPTREE_BLOOM_H
+#define BPTREE_BLOOM_H
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "utility.h"
+
+namespace arima_kana {
+
+    /// @Bloom_Filter
+    /// a fixed-size Bloom filter of `bits` bits probed `probes` times
+    /// by double hashing a 64-bit key hash
+    template<size_t bits, size_t probes>
+    struct Bloom_Filter {
+      static constexpr size_t WORDS = (bits + 63) / 64;
+
+      uint64_t _w[WORDS] = {0};
+
+      void add(unsigned long long h) {
+        unsigned long long h2 = (h >> 32 | h << 32) | 1;
+        for (size_t i = 0; i < probes; ++i, h += h2) {
+          size_t b = h % (WORDS * 64);
+          _w[b / 64] |= uint64_t(1) << (b % 64);
+        }
+      }
+
+      bool may_contain(unsigned long long h) const {
+        unsigned long long h2 = (h >> 32 | h << 32) | 1;
+        for (size_t i = 0; i < probes; ++i, h += h2) {
+          size_t b = h % (WORDS * 64);
+          if (!(_w[b / 64] >> (b % 64) & 1)) return false;
+        }
+        return true;
+      }
+
+      void reset() {
+        for (auto &w: _w) w = 0;
+      }
+    };
+
+    constexpr size_t bloom_probes(size_t bits, size_t keys) {
+      size_t k = bits * 7 / (keys * 10);
+      return k < 1 ? 1 : (k > 16 ? 16 : k);
+    }
+
+    /// @Block_Bloom
+    /// one Bloom filter per data block, indexed by block id (1-based)
+    /// and kept in the side file `name`.
+    /// `bits` is the size of each filter; with `keys` pairs per block
+    /// the false-positive rate is about 0.6185 ^ (bits / keys).
+    /// Removals leave stale bits behind; a filter is rebuilt when its block splits.
+    /// A block without a filter (a missing or unreadable side file) may contain anything.
+    template<class K, size_t bits, size_t keys>
+    class Block_Bloom {
+    public:
+      /// ln 2 * bits per key probes minimize the false-positive rate
+      static constexpr size_t PROBES = bloom_probes(bits, keys);
+
+      typedef Bloom_Filter<bits, PROBES> filter;
+
+      size_t checks = 0;
+      size_t skips = 0;
+
+    private:
+      vector<filter> filters;
+      std::string name;
+
+      filter &at(size_t block) {
+        while (filters.size() <= block) filters.push_back(filter());
+        return filters[block];
+      }
+
+    public:
+      /// a side file whose length does not match its count
+      /// (written with another filter size, or cut short) is ignored
+      explicit Block_Bloom(const std::string &fn) : name(fn) {
+        std::fstream f(name, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!f.is_open()) return;
+        size_t len = size_t(f.tellg()), n = 0;
+        f.seekg(0);
+        f.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+        if (!f || len != sizeof(size_t) + n * sizeof(filter)) return;
+        filter tmp;
+        for (size_t i = 0; i < n; ++i) {
+          f.read(reinterpret_cast<char *>(&tmp), sizeof(filter));
+          filters.push_back(tmp);
+        }
+      }
+
+      ~Block_Bloom() {
+        save();
+      }
+
+      /// @save writes the filters to the side file
+      void save() {
+        std::fstream f(name, std::ios::out | std::ios::binary);
+        size_t n = filters.size();
+        f.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+        for (size_t i = 0; i < n; ++i) {
+          f.write(reinterpret_cast<char *>(&filters[i]), sizeof(filter));
+        }
+      }
+
+      void add(size_t block, const K &k) {
+        at(block).add(hash(k));
+      }
+
+      bool may_contain(size_t block, const K &k) {
+        ++checks;
+        if (block >= filters.size() || filters[block].may_contain(hash(k))) return true;
+        ++skips;
+        return false;
+      }
+
+      /// @covers whether there is a filter for each of blocks 1 .. blocks
+      /// and for no others, as after a run that kept the side file up to date
+      bool covers(size_t blocks) const {
+        return filters.size() == (blocks == 0 ? 0 : blocks + 1);
+      }
+
+      /// @rebuild refills the filter of a block from its contents
+      template<class Node>
+      void rebuild(size_t block, const Node &node) {
+        filter &f = at(block);
+        f.reset();
+        for (size_t i = 0; i < node.size; ++i) {
+          f.add(hash(node._data.key(i)));
+        }
+      }
+
+      void clear() {
+        filters.clear();
+      }
+    };
+
+    /// bits == 0 disables the filters
+    template<class K, size_t keys>
+    class Block_Bloom<K, 0, keys> {
+    public:
+      size_t checks = 0;
+      size_t skips = 0;
+
+      /// drops a side file left by a run with filters,
+      /// since it goes stale as soon as blocks change here
+      explicit Block_Bloom(const std::string &fn) {
+        std::remove(fn.c_str());
+      }
+
+      void add(size_t, const K &) {}
+
+      bool may_contain(size_t, const K &) { return true; }
+
+      bool covers(size_t) const { return true; }
+
+      template<class Node>
+      void rebuild(size_t, const Node &) {}
+
+      void save() {}
+
+      void clear() {}
+    };
+
+}
+
+#endif //BPTREE_BLOOM_H
@@ -5,7 +5,18 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include "map.h"
+#include "Page.h"
+#include "Compress.h"
+#include "error.h"
 
 namespace arima_kana {
     template<class T, class pre, size_t num>
@@ -14,18 +25,146 @@ namespace arima_kana {
       static constexpr int SIZE_T = sizeof(T);
       static constexpr int SIZE_PRE = sizeof(pre);
 
-      void read_node(T &dn, size_t pos) {
-        file.open(name, std::ios::in | std::ios::out | std::ios::binary);
-        file.seekg(num * SIZE_PRE + (pos - 1) * SIZE_T);
+      /// the header of num pre's is padded to the alignment of T
+      static constexpr size_t offset(size_t pos) {
+        return round_up(num * SIZE_PRE, alignof(T)) + (pos - 1) * SIZE_T;
+      }
+
+      /// read_node and write_node reuse the file if it is already open,
+      /// so that a flush opens it only once
+      virtual void read_node(T &dn, size_t pos) {
+        ++reads;
+        if (fd >= 0) {
+          read_nodes(&dn, pos, 1);
+          return;
+        }
+        bool opened = file.is_open();
+        if (!opened) file.open(name, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(offset(pos));
         file.read(reinterpret_cast<char *>(&dn), SIZE_T);
-        file.close();
+        if (!opened) file.close();
+        else file.clear();
       }
 
-      void write_node(T &dn, size_t pos) {
-        file.open(name, std::ios::in | std::ios::out | std::ios::binary);
-        file.seekp(num * SIZE_PRE + (pos - 1) * SIZE_T);
+      virtual void write_node(T &dn, size_t pos) {
+        ++writes;
+        if (fd >= 0) {
+          if (pwrite(fd, &dn, SIZE_T, off_t(offset(pos))) != SIZE_T) error("write failed: " + name);
+          return;
+        }
+        bool opened = file.is_open();
+        if (!opened) file.open(name, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offset(pos));
         file.write(reinterpret_cast<char *>(&dn), SIZE_T);
-        file.close();
+        if (!opened) file.close();
+      }
+
+      /// @write_nodes
+      /// writes nodes[0 .. count) to positions pos, pos + 1, ...
+      /// with one pwritev, a node per iovec (count is at most IOV_MAX);
+      /// falls back to write_node if that fails.
+      /// Outside direct mode the descriptor stays open until end_writes
+      virtual void write_nodes(T *const *nodes, size_t pos, size_t count) {
+        if (fd < 0 && out_fd < 0) out_fd = ::open(name.c_str(), O_WRONLY | O_CREAT, 0644);
+        int wfd = fd >= 0 ? fd : out_fd;
+        bool done = false;
+        if (wfd >= 0) {
+          iovec iov[IOV_MAX];
+          for (size_t i = 0; i < count; ++i) iov[i] = {nodes[i], size_t(SIZE_T)};
+          done = pwritev(wfd, iov, int(count), off_t(offset(pos))) == long(count * SIZE_T);
+        }
+        if (done) {
+          writes += count;
+          return;
+        }
+        for (size_t i = 0; i < count; ++i) write_node(*nodes[i], pos + i);
+      }
+
+      /// @append_node
+      /// writes dn behind the last node of the file
+      void append_node(const T &dn) {
+        ++writes;
+        if (fd >= 0) {
+          off_t end = lseek(fd, 0, SEEK_END);
+          if (end < 0 || pwrite(fd, &dn, SIZE_T, end) != SIZE_T) error("write failed: " + name);
+          return;
+        }
+        std::fstream f(name, std::ios::app | std::ios::binary);
+        f.write(reinterpret_cast<const char *>(&dn), SIZE_T);
+      }
+
+      /// @write_header
+      /// writes the num pre's of the file header; fresh cuts the file
+      /// and pads the header out to the first node, for a new or cleared file.
+      /// In direct mode the padded header goes through the O_DIRECT descriptor
+      /// like the nodes, so no buffered write is left to land on the file
+      /// after a direct one
+      void write_header(const pre *h, bool fresh = false) {
+        if (fd >= 0) {
+          size_t len = offset(1);
+          std::unique_ptr<char, decltype(&std::free)> page(
+                  static_cast<char *>(std::aligned_alloc(DIRECT_ALIGN, len)), &std::free);
+          std::memset(page.get(), 0, len);
+          std::memcpy(page.get(), h, num * SIZE_PRE);
+          if (fresh && ftruncate(fd, 0) != 0) error("truncate failed: " + name);
+          if (pwrite(fd, page.get(), len, 0) != long(len)) error("write failed: " + name);
+          return;
+        }
+        std::fstream f(name, fresh ? std::ios::out | std::ios::binary
+                                   : std::ios::in | std::ios::out | std::ios::binary);
+        f.write(reinterpret_cast<const char *>(h), num * SIZE_PRE);
+        if (fresh) for (size_t i = num * SIZE_PRE; i < offset(1); ++i) f.put(0);
+      }
+
+      void end_writes() {
+        if (out_fd >= 0) ::close(out_fd);
+        out_fd = -1;
+      }
+
+      /// @read_nodes
+      /// reads nodes [pos, pos + count) into dst with one read,
+      /// returning how many were there
+      size_t read_nodes(T *dst, size_t pos, size_t count) {
+        if (fd >= 0) {
+          iovec iov = {dst, count * SIZE_T};
+          long got = long(preadv(fd, &iov, 1, off_t(offset(pos))));
+          if (got < 0) error("read failed: " + name);
+          return size_t(got) / SIZE_T;
+        }
+        bool opened = file.is_open();
+        if (!opened) file.open(name, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(offset(pos));
+        file.read(reinterpret_cast<char *>(dst), std::streamsize(count * SIZE_T));
+        size_t got = size_t(file.gcount()) / SIZE_T;
+        if (!opened) file.close();
+        else file.clear();
+        return got;
+      }
+
+      /// nodes, their offsets and their sizes must be multiples of this for O_DIRECT
+      static constexpr size_t DIRECT_ALIGN = 4096;
+      static constexpr bool direct_capable = alignof(T) % DIRECT_ALIGN == 0 && SIZE_T % DIRECT_ALIGN == 0;
+
+      /// @use_direct
+      /// moves node I/O to pread/pwrite on a descriptor opened with O_DIRECT,
+      /// so the nodes are cached here only and not again by the kernel.
+      /// T has to be a page_frame of at least DIRECT_ALIGN bytes;
+      /// false, with buffered I/O kept, if it is not or the file system refuses.
+      /// Buffered writes still pending on the file are flushed first
+      bool use_direct() {
+#ifdef O_DIRECT
+        if constexpr (direct_capable) {
+          if (file.is_open()) file.close();
+          end_writes();
+          if (fd < 0) fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+          return fd >= 0;
+        }
+#endif
+        return false;
+      }
+
+      bool direct() const {
+        return fd >= 0;
       }
 
       virtual T &operator[](size_t pos) = 0;
@@ -35,9 +174,18 @@ namespace arima_kana {
 
       std::fstream file;
       std::string name;
+      int fd = -1;// open while direct I/O is on
+      int out_fd = -1;// opened by write_nodes, kept until end_writes
+      size_t reads = 0;// nodes read from and written to the file
+      size_t writes = 0;
     public:
       Buffer(const std::string &fn) : name(fn) {}
 
+      virtual ~Buffer() {
+        if (fd >= 0) ::close(fd);
+        end_writes();
+      }
+
     };
 
 
@@ -185,6 +333,8 @@ namespace arima_kana {
 //        T copy;
         Node *next;
         Node *prev;
+        bool ahead = false;// read ahead and not used yet
+        bool dirty = false;// handed out by operator[] since it was last written
       };
 
 
@@ -192,8 +342,14 @@ namespace arima_kana {
       Node *tail;
       size_t _size;
       std::unordered_map<size_t, Node *> m;
+      size_t last_miss = 0;
 
     public:
+      size_t prefetch_depth = 0;// nodes per read-ahead, 0 disables it
+      size_t prefetched = 0;// nodes read ahead of use
+      size_t prefetch_hits = 0;// of those, used before eviction
+      size_t max_run = IOV_MAX;// nodes per vectored write in checkpoint
+      size_t write_runs = 0;// vectored writes issued by checkpoints
 
       explicit List_Map_Buffer(const std::string &fn) :
               Buffer<T, pre, num>(fn) {
@@ -217,23 +373,110 @@ namespace arima_kana {
         m.clear();
       }
 
-      ~List_Map_Buffer() {
+      /// @checkpoint
+      /// writes every dirty cached node back and keeps it cached, clean;
+      /// the nodes go out in file order, each run of adjacent ones
+      /// (up to max_run) through one write_nodes
+      void checkpoint() {
+        vector<Node *> nodes;
+        for (Node *tmp = head->next; tmp != tail; tmp = tmp->next) {
+          if (tmp->dirty) nodes.push_back(tmp);
+        }
+        if (nodes.size() == 0) return;
+        std::sort(&nodes[0], &nodes[0] + nodes.size(), [](const Node *a, const Node *b) { return a->pos < b->pos; });
+        size_t cap = max_run == 0 ? 1 : max_run < IOV_MAX ? max_run : IOV_MAX;
+        vector<T *> run;
+        for (size_t i = 0; i < nodes.size();) {
+          run.clear();
+          size_t j = i;
+          while (j < nodes.size() && j - i < cap && nodes[j]->pos == nodes[i]->pos + (j - i)) run.push_back(&nodes[j++]->data);
+          this->write_nodes(&run[0], nodes[i]->pos, run.size());
+          ++write_runs;
+          for (; i < j; ++i) nodes[i]->dirty = false;
+        }
+        this->end_writes();
+      }
+
+      /// @flush
+      /// checkpoints and empties the cache;
+      /// a derived buffer flushes in its own destructor,
+      /// since write_nodes is virtual
+      void flush() {
+        checkpoint();
         Node *tmp = head->next;
-        this->file.open(this->name, std::ios::in | std::ios::out | std::ios::binary);
         while (tmp != tail) {
-          this->file.seekp(num * this->SIZE_PRE + (tmp->pos - 1) * this->SIZE_T);
-          this->file.write(reinterpret_cast<char *>(&tmp->data), this->SIZE_T);
           Node *tmp2 = tmp;
           tmp = tmp->next;
           delete tmp2;
         }
-        this->file.close();
+        head->next = tail;
+        tail->prev = head;
+        _size = 0;
+        m.clear();
+      }
+
+      ~List_Map_Buffer() {
+        flush();
         delete head;
         delete tail;
-        m.clear();
       }
 
+      /// @operator[]
+      /// node pos for writing: it is written back by the next checkpoint
+      /// or when it is evicted
       T &operator[](size_t pos) {
+        Node *n = fetch(pos);
+        n->dirty = true;
+        return n->data;
+      }
+
+      /// @get
+      /// node pos for reading only, it stays clean
+      const T &get(size_t pos) {
+        return fetch(pos)->data;
+      }
+
+      bool cached(size_t pos) const {
+        return m.find(pos) != m.end();
+      }
+
+      /// @prefetch
+      /// reads nodes [pos, pos + count) in one go, at most prefetch_depth of them,
+      /// and caches those that were not cached before the read.
+      /// Returns the number cached; the file may end early
+      size_t prefetch(size_t pos, size_t count) {
+        if (count > prefetch_depth) count = prefetch_depth;
+        if (count == 0) return 0;
+        // taken before the read: admitting the run may evict a cached node of it,
+        // and the copy read here would then be older than the one written back
+        std::unique_ptr<bool[]> held(new bool[count]);
+        for (size_t i = 0; i < count; ++i) held[i] = cached(pos + i);
+        std::unique_ptr<T[]> run(new T[count]);
+        size_t got = this->read_nodes(run.get(), pos, count);
+        size_t added = 0;
+        for (size_t i = 0; i < got; ++i) {
+          if (held[i]) continue;
+          ++this->reads;
+          Node *n = new Node{pos + i, run[i], head->next, head};
+          n->ahead = true;
+          admit(n);
+          ++prefetched, ++added;
+        }
+        return added;
+      }
+
+      /// @install
+      /// caches data as node pos, read from the file by the caller
+      /// (see BlockRiver::find_batch); a cached copy wins
+      void install(size_t pos, const T &data) {
+        if (cached(pos)) return;
+        ++this->reads;
+        admit(new Node{pos, data, head->next, head});
+      }
+
+    private:
+      /// the cached node pos, read from the file on a miss
+      Node *fetch(size_t pos) {
         auto it = m.find(pos);
         if (it != m.end()) {
           Node *tmp = it->second;
@@ -244,26 +487,253 @@ namespace arima_kana {
             tmp->prev = head;
             head->next->prev = tmp;
             head->next = tmp;
-            return tmp->data;
+            if (tmp->ahead) {
+              tmp->ahead = false;
+              ++prefetch_hits;
+            }
+            return tmp;
+          }
+        }
+        // a miss right behind the last one reads ahead
+        bool sequential = prefetch_depth > 1 && pos == last_miss + 1;
+        last_miss = pos;
+        if (sequential && prefetch(pos, prefetch_depth) > 0) {
+          it = m.find(pos);
+          if (it != m.end()) {
+            it->second->ahead = false;
+            --prefetched;
+            last_miss = pos + prefetch_depth - 1;
+            return it->second;
           }
         }
         Node *new_n = new Node{pos, T(), head->next, head};
         this->read_node(new_n->data, pos);
 //        new_n->copy = new_n->data;
+        admit(new_n);
+        return new_n;
+      }
+
+      /// links a new node in front, evicting the last one if over capacity;
+      /// only a dirty one is written back
+      void admit(Node *new_n) {
         head->next->prev = new_n;
         head->next = new_n;
-        m.insert({pos, new_n});
+        m.insert({new_n->pos, new_n});
         ++_size;
         if (_size > _cap) {
           Node *tmp = tail->prev;
           tmp->prev->next = tail;
           tail->prev = tmp->prev;
-          this->write_node(tmp->data, tmp->pos);
+          if (tmp->dirty) this->write_node(tmp->data, tmp->pos);
           m.erase(tmp->pos);
           delete tmp;
           --_size;
         }
-        return new_n->data;
+      }
+
+    };
+
+
+    /// @Compressed_Buffer
+    /// an LRU buffer over a file of variable-length compressed nodes.
+    /// The page translation table (stored in name + "_ptt")
+    /// maps a node position to its extent in the file;
+    /// a node that outgrows its extent gives it back and takes the smallest
+    /// free extent that fits (merged with its neighbours, so a node can grow
+    /// into the space around it), or else room at the end of the file.
+    /// Free extents are the gaps between those in the table, found again on open.
+    /// Each write_node updates the node's table entry on disk right after the node,
+    /// through a stream kept open with the buffer, so that moved extents survive a crash.
+    template<class T, class pre, size_t num, size_t _cap>
+    class Compressed_Buffer : public List_Map_Buffer<T, pre, num, _cap> {
+
+      struct extent {
+        size_t offset;
+        size_t length;
+        size_t capacity;
+      };
+
+      static constexpr size_t EXTENT_ALIGN = 64;
+
+      vector<extent> table;
+      std::map<size_t, size_t> free_extents;// offset to capacity, none adjacent
+      size_t file_end;
+      std::string ptt_name;
+      std::fstream ptt;
+      std::string bytes;
+
+      void init_table() {
+        table.clear();
+        free_extents.clear();
+        file_end = this->offset(1);
+      }
+
+      void read_table() {
+        ptt.seekg(0);
+        size_t n = 0;
+        ptt.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+        ptt.read(reinterpret_cast<char *>(&file_end), sizeof(size_t));
+        extent e{};
+        for (size_t i = 0; ptt && i < n; ++i) {
+          ptt.read(reinterpret_cast<char *>(&e), sizeof(extent));
+          table.push_back(e);
+        }
+        if (!ptt) {
+          ptt.clear();
+          init_table();
+          return;
+        }
+        vector<pair<size_t, size_t>> used;// offset, capacity
+        for (size_t i = 0; i < table.size(); ++i) {
+          if (table[i].capacity != 0) used.push_back({table[i].offset, table[i].capacity});
+        }
+        if (used.size() > 0) std::sort(&used[0], &used[0] + used.size());
+        size_t at = this->offset(1);
+        for (size_t i = 0; i < used.size(); ++i) {
+          if (used[i].first > at) free_extents[at] = used[i].first - at;
+          at = std::max(at, used[i].first + used[i].second);
+        }
+        file_end = at;
+      }
+
+      void write_table() {
+        size_t n = table.size();
+        ptt.seekp(0);
+        ptt.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+        ptt.write(reinterpret_cast<char *>(&file_end), sizeof(size_t));
+        for (size_t i = 0; i < n; ++i) {
+          ptt.write(reinterpret_cast<char *>(&table[i]), sizeof(extent));
+        }
+        ptt.flush();
+      }
+
+      /// rewrites the entry of pos and the table header in place;
+      /// entries skipped over read back as empty extents
+      void write_entry(size_t pos) {
+        size_t n = table.size();
+        ptt.seekp(0);
+        ptt.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+        ptt.write(reinterpret_cast<char *>(&file_end), sizeof(size_t));
+        ptt.seekp(2 * sizeof(size_t) + pos * sizeof(extent));
+        ptt.write(reinterpret_cast<char *>(&table[pos]), sizeof(extent));
+        ptt.flush();
+      }
+
+      /// frees [at, at + capacity), merging it with free neighbours
+      /// or handing it back to the end of the file
+      void release(size_t at, size_t capacity) {
+        auto next = free_extents.lower_bound(at);
+        if (next != free_extents.end() && at + capacity == next->first) {
+          capacity += next->second;
+          next = free_extents.erase(next);
+        }
+        if (next != free_extents.begin()) {
+          auto prev = std::prev(next);
+          if (prev->first + prev->second == at) {
+            at = prev->first;
+            capacity += prev->second;
+            free_extents.erase(prev);
+          }
+        }
+        if (at + capacity == file_end) file_end = at;
+        else free_extents[at] = capacity;
+      }
+
+      /// the offset of capacity free bytes: the smallest free extent
+      /// that holds them, or the end of the file
+      size_t allocate(size_t capacity) {
+        auto best = free_extents.end();
+        for (auto it = free_extents.begin(); it != free_extents.end(); ++it) {
+          if (it->second >= capacity && (best == free_extents.end() || it->second < best->second)) best = it;
+        }
+        if (best == free_extents.end()) {
+          file_end += capacity;
+          return file_end - capacity;
+        }
+        size_t at = best->first, left = best->second - capacity;
+        free_extents.erase(best);
+        if (left > 0) free_extents[at + capacity] = left;
+        return at;
+      }
+
+      /// gives e room for need bytes in place of its extent
+      void place(extent &e, size_t need) {
+        if (e.capacity != 0) release(e.offset, e.capacity);
+        e.capacity = round_up(need, EXTENT_ALIGN);
+        e.offset = allocate(e.capacity);
+      }
+
+    public:
+
+      explicit Compressed_Buffer(const std::string &fn) :
+              List_Map_Buffer<T, pre, num, _cap>(fn), ptt_name(fn + "_ptt") {
+        init_table();
+        std::fstream(ptt_name, std::ios::app | std::ios::binary);
+        ptt.open(ptt_name, std::ios::in | std::ios::out | std::ios::binary);
+        if (!ptt.is_open()) error("cannot open " + ptt_name);
+        read_table();
+      }
+
+      ~Compressed_Buffer() {
+        this->flush();
+        write_table();
+      }
+
+      /// extents are not laid out by position, so a run is written node by node
+      void write_nodes(T *const *nodes, size_t pos, size_t count) {
+        bool opened = this->file.is_open();
+        if (!opened) this->file.open(this->name, std::ios::in | std::ios::out | std::ios::binary);
+        for (size_t i = 0; i < count; ++i) write_node(*nodes[i], pos + i);
+        if (!opened) this->file.close();
+      }
+
+      void checkpoint() {
+        List_Map_Buffer<T, pre, num, _cap>::checkpoint();
+        write_table();
+      }
+
+      void clear() {
+        List_Map_Buffer<T, pre, num, _cap>::clear();
+        init_table();
+        write_table();
+      }
+
+      void read_node(T &dn, size_t pos) {
+        ++this->reads;
+        if (pos >= table.size() || table[pos].length == 0) {
+          dn = T();
+          return;
+        }
+        bool opened = this->file.is_open();
+        if (!opened) this->file.open(this->name, std::ios::in | std::ios::out | std::ios::binary);
+        bytes.resize(table[pos].length);
+        this->file.seekg(table[pos].offset);
+        this->file.read(&bytes[0], table[pos].length);
+        if (!opened) this->file.close();
+        unpack_block(dn, bytes.data(), bytes.size());
+      }
+
+      void write_node(T &dn, size_t pos) {
+        ++this->writes;
+        pack_block(dn, bytes);
+        while (table.size() <= pos) table.push_back({0, 0, 0});
+        extent &e = table[pos];
+        if (e.capacity < bytes.size()) place(e, bytes.size());
+        e.length = bytes.size();
+        bool opened = this->file.is_open();
+        if (!opened) this->file.open(this->name, std::ios::in | std::ios::out | std::ios::binary);
+        this->file.seekp(e.offset);
+        this->file.write(bytes.data(), bytes.size());
+        if (!opened) this->file.close();
+        else this->file.flush();
+        write_entry(pos);
+      }
+
+      /// @stored_bytes bytes of the data file in use by extents
+      size_t stored_bytes() const {
+        size_t free = 0;
+        for (auto &f: free_extents) free += f.second;
+        return file_end - free;
       }
 
     };
@@ -0,0 +1,189 @@
+#ifndef BPTREE_COMPRESS_H
+#define BPTREE_COMPRESS_H
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include "utility.h"
+#include "error.h"
+
+namespace arima_kana {
+
+    /// @key_bytes
+    /// number of significant bytes of a key,
+    /// the rest of sizeof(K) is zero after unpacking
+    template<class K>
+    size_t key_bytes(const K &) {
+      return sizeof(K);
+    }
+
+    template<int length>
+    size_t key_bytes(const m_string<length> &k) {
+      return strnlen(k.id, length);
+    }
+
+    inline void put_varint(std::string &out, size_t x) {
+      while (x >= 0x80) {
+        out.push_back(char(x | 0x80));
+        x >>= 7;
+      }
+      out.push_back(char(x));
+    }
+
+    inline size_t get_varint(const char *&ip, const char *end) {
+      size_t x = 0;
+      for (int shift = 0; ip < end && shift < 64; shift += 7) {
+        auto b = (unsigned char) *ip++;
+        x |= size_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return x;
+      }
+      error("Corrupted varint");
+      return 0;
+    }
+
+    /// @lz_compress
+    /// a byte-oriented LZ77 codec in the spirit of LZ4:
+    /// each sequence is a token (literal length << 4 | match length - 4),
+    /// the literals, a 2-byte offset and the extended match length.
+    /// The last sequence carries literals only.
+    inline void lz_compress(const char *src, size_t n, std::string &out) {
+      static constexpr int HASH_BITS = 12;
+      static constexpr size_t MIN_MATCH = 4, MAX_OFFSET = 65535;
+      uint32_t table[1 << HASH_BITS];
+      for (auto &t: table) t = UINT32_MAX;
+      auto read32 = [src](size_t i) {
+        uint32_t x;
+        memcpy(&x, src + i, 4);
+        return x;
+      };
+      auto put_len = [&out](size_t len) {
+        while (len >= 255) {
+          out.push_back(char(255));
+          len -= 255;
+        }
+        out.push_back(char(len));
+      };
+      auto put_seq = [&](size_t anchor, size_t lit, size_t offset, size_t match, bool last) {
+        size_t m = last ? 0 : match - MIN_MATCH;
+        out.push_back(char((lit < 15 ? lit : 15) << 4 | (m < 15 ? m : 15)));
+        if (lit >= 15) put_len(lit - 15);
+        out.append(src + anchor, lit);
+        if (last) return;
+        out.push_back(char(offset & 0xff));
+        out.push_back(char(offset >> 8));
+        if (m >= 15) put_len(m - 15);
+      };
+      size_t i = 0, anchor = 0;
+      while (i + MIN_MATCH <= n) {
+        uint32_t seq = read32(i);
+        uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        uint32_t cand = table[h];
+        table[h] = (uint32_t) i;
+        if (cand != UINT32_MAX && i - cand <= MAX_OFFSET && read32(cand) == seq) {
+          size_t len = MIN_MATCH;
+          while (i + len < n && src[cand + len] == src[i + len]) ++len;
+          put_seq(anchor, i - anchor, i - cand, len, false);
+          i += len;
+          anchor = i;
+        } else {
+          ++i;
+        }
+      }
+      put_seq(anchor, n - anchor, 0, 0, true);
+    }
+
+    /// @lz_decompress
+    /// inverse of lz_compress, writes at most cap bytes to dst
+    /// and returns the number of bytes written
+    inline size_t lz_decompress(const char *ip, size_t n, char *dst, size_t cap) {
+      const char *end = ip + n;
+      size_t op = 0;
+      auto get_len = [&ip, end](size_t len) {
+        unsigned char b;
+        do {
+          if (ip >= end) error("Corrupted block");
+          b = (unsigned char) *ip++;
+          len += b;
+        } while (b == 255);
+        return len;
+      };
+      while (ip < end) {
+        auto token = (unsigned char) *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15) lit = get_len(lit);
+        if (lit > size_t(end - ip) || op + lit > cap) error("Corrupted block");
+        memcpy(dst + op, ip, lit);
+        ip += lit, op += lit;
+        if (ip == end) break;
+        if (end - ip < 2) error("Corrupted block");
+        size_t offset = (unsigned char) ip[0] | size_t((unsigned char) ip[1]) << 8;
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15) match = get_len(match);
+        match += 4;
+        if (offset == 0 || offset > op || op + match > cap) error("Corrupted block");
+        for (size_t j = 0; j < match; ++j, ++op) dst[op] = dst[op - offset];
+      }
+      return op;
+    }
+
+    /// @pack_block
+    /// prefix-codes the sorted keys of a data node
+    /// and compresses the result with lz_compress
+    template<class Node>
+    void pack_block(const Node &node, std::string &out) {
+      typedef typename Node::p p;
+      typedef decltype(p::first) K;
+      typedef decltype(p::second) V;
+      std::string raw;
+      put_varint(raw, node.size);
+      const char *prev = nullptr;
+      size_t prev_len = 0;
+      for (size_t i = 0; i < node.size; ++i) {
+        const K &k = node._data.key(i);
+        auto bytes = reinterpret_cast<const char *>(&k);
+        size_t len = key_bytes(k), shared = 0;
+        while (shared < len && shared < prev_len && bytes[shared] == prev[shared]) ++shared;
+        put_varint(raw, shared);
+        put_varint(raw, len - shared);
+        raw.append(bytes + shared, len - shared);
+        raw.append(reinterpret_cast<const char *>(&node._data.value(i)), sizeof(V));
+        prev = bytes, prev_len = len;
+      }
+      out.clear();
+      put_varint(out, raw.size());
+      lz_compress(raw.data(), raw.size(), out);
+    }
+
+    /// @unpack_block inverse of pack_block
+    template<class Node>
+    void unpack_block(Node &node, const char *ip, size_t n) {
+      typedef typename Node::p p;
+      typedef decltype(p::first) K;
+      typedef decltype(p::second) V;
+      const char *end = ip + n;
+      size_t raw_len = get_varint(ip, end);
+      std::string raw(raw_len, '\0');
+      if (lz_decompress(ip, end - ip, &raw[0], raw_len) != raw_len) error("Corrupted block");
+      ip = raw.data(), end = ip + raw_len;
+      size_t size = get_varint(ip, end);
+      char key[sizeof(K)] = {0};
+      for (size_t i = 0; i < size; ++i) {
+        size_t shared = get_varint(ip, end), rest = get_varint(ip, end);
+        if (shared + rest > sizeof(K) || rest + sizeof(V) > size_t(end - ip)) error("Corrupted block");
+        memcpy(key + shared, ip, rest);
+        memset(key + shared + rest, 0, sizeof(K) - shared - rest);
+        ip += rest;
+        p kv;
+        memcpy(reinterpret_cast<char *>(&kv.first), key, sizeof(K));
+        memcpy(reinterpret_cast<char *>(&kv.second), ip, sizeof(V));
+        ip += sizeof(V);
+        node.set_pair(i, kv);
+      }
+      node.size = size;
+    }
+
+}
+
+#endif //BPTREE_COMPRESS_H
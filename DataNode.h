@@ -3,56 +3,112 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
+#include <cstring>
 #include "utility.h"
 #include "error.h"
+#include "Layout.h"
 
 namespace arima_kana {
-    template<class K, class V, size_t block>
+    template<class K, class V, size_t block, class Layout = aos_layout>
     class DataNode {
     public:
 
       typedef pair<K, V> p;
+      typedef typename Layout::template storage<K, V, block> storage;
 
       size_t size = 0;
-      p _data[block];
+      uint8_t _fp[block] = {0};// one-byte fingerprint of each key
+      storage _data;
 
       DataNode() = default;
 
       explicit DataNode(const p &kv) : size(1) {
-        _data[0] = kv;
+        set_pair(0, kv);
       }
 
-      void insert_pair(K key, V val) {
-        int l = 0, r = size;
-        auto tmp_pair = p({key, val});
+      static uint8_t fingerprint(const K &key) {
+        auto h = hash(key);
+        return uint8_t(h ^ h >> 56);
+      }
+
+      void set_pair(size_t i, const p &kv) {
+        _data.set(i, kv);
+        _fp[i] = fingerprint(kv.first);
+      }
+
+      void move_pair(size_t dst, size_t src) {
+        _data.move(dst, src);
+        _fp[dst] = _fp[src];
+      }
+
+      /// @split
+      /// moves the first half of this node to front
+      void split(DataNode &front) {
+        size_t half = size / 2;
+        for (size_t i = 0; i < half; ++i) {
+          front._data.assign(i, _data, i);
+          front._fp[i] = _fp[i];
+        }
+        for (size_t i = half; i < size; ++i) {
+          move_pair(i - half, i);
+        }
+        front.size = half;
+        size -= half;
+      }
+
+      /// @find_first
+      /// the first slot holding key (fp is its fingerprint),
+      /// or size if the key is absent.
+      /// Blocks without a matching fingerprint are skipped
+      /// without a single key comparison.
+      size_t find_first(const K &key, uint8_t fp) const {
+        if (size == 0 || memchr(_fp, fp, size) == nullptr) return size;
+        size_t l = 0, r = size;
+        while (l < r) {
+          size_t mid = (l + r) / 2;
+          if (_data.key(mid) < key) l = mid + 1;
+          else r = mid;
+        }
+        return l;
+      }
+
+      /// whether slot i holds key, checking the fingerprint first
+      bool match(size_t i, const K &key, uint8_t fp) const {
+        return i < size && _fp[i] == fp && _data.key(i) == key;
+      }
+
+      size_t lower_bound(const p &kv) const {
+        size_t l = 0, r = size;
         while (l < r) {
-          int mid = (l + r) / 2;
-          if (_data[mid] < tmp_pair) l = mid + 1;
+          size_t mid = (l + r) / 2;
+          if (slot_less(_data, mid, kv)) l = mid + 1;
           else r = mid;
         }
-        if (_data[l] == tmp_pair) {
+        return l;
+      }
+
+      void insert_pair(K key, V val) {
+        auto tmp_pair = p({key, val});
+        size_t r = lower_bound(tmp_pair);
+        if (r < size && slot_equal(_data, r, tmp_pair)) {
           error("Duplicated key and value");
         }
         for (size_t i = size; i > r; --i) {
-          _data[i] = _data[i - 1];
+          move_pair(i, i - 1);
         }
-        _data[r] = tmp_pair;
+        set_pair(r, tmp_pair);
         ++size;
       }
 
       void remove_pair(K key, V val) {
-        int l = 0, r = size;
         auto tmp_pair = p({key, val});
-        while (l < r) {
-          int mid = (l + r) / 2;
-          if (_data[mid] < tmp_pair) l = mid + 1;
-          else r = mid;
-        }
-        if (_data[l] != tmp_pair) {
+        size_t l = lower_bound(tmp_pair);
+        if (l == size || !slot_equal(_data, l, tmp_pair)) {
           error("Key-value pair not found");
         }
         for (size_t i = l; i < size - 1; ++i) {
-          _data[i] = _data[i + 1];
+          move_pair(i, i + 1);
         }
         --size;
       }
@@ -61,35 +117,40 @@ namespace arima_kana {
         static size_t pos = -1;
         if (pos != -1) {
           ++pos;
-          if (_data[pos].key == key) return _data[pos].value;
+          if (pos < size && _data.key(pos) == key) return _data.value(pos);
           else return {};
         }
         size_t l = 0, r = size;
         while (l < r) {
           size_t mid = (l + r) / 2;
-          if (_data[mid].key < key) l = mid;
+          if (_data.key(mid) < key) l = mid + 1;
           else r = mid;
         }
-        if (_data[r].key == key) {
+        if (r < size && _data.key(r) == key) {
           pos = r;
-          return _data[r].value;
+          return _data.value(r);
         } else {
           pos = -1;
           return {};
         }
       }
 
-      void print() {
+      /// @max_pair the largest pair stored in the block
+      p max_pair() const {
+        return _data.get(size - 1);
+      }
+
+      void print() const {
         std::cout << "___" << '\n';
         for (int i = 0; i < size; ++i) {
-          std::cout << "   " << _data[i].first << "   " << _data[i].second << '\n';
+          std::cout << "   " << _data.key(i) << "   " << _data.value(i) << '\n';
         }
       }
 
       bool operator==(const DataNode &other) const {
         if (size != other.size) return false;
         for (int i = 0; i < size; ++i) {
-          if (_data[i] != other._data[i]) return false;
+          if (!slot_equal(_data, i, other._data.get(i))) return false;
         }
         return true;
       }
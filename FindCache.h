@@ -0,0 +1,89 @@
+#ifndef BPTREE_FINDCACHE_H
+#define BPTREE_FINDCACHE_H
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "utility.h"
+
+namespace arima_kana {
+
+    /// @Find_Cache
+    /// a direct-mapped cache of find results in front of a BlockRiver
+    /// (or a Mem_Table), `slots` entries indexed by hash(k).
+    /// A key holding more than `max_values` values is not cached.
+    /// insert and remove drop the entry of their key only.
+    template<class River, size_t slots = 4096, size_t max_values = 64>
+    class Find_Cache {
+    public:
+      typedef typename River::KV KV;
+      typedef decltype(KV::first) K;
+      typedef decltype(KV::second) V;
+
+      River river;
+      size_t hits = 0;
+      size_t misses = 0;
+
+    private:
+      struct slot {
+        bool used = false;
+        K key;
+        vector<V> values;
+      };
+
+      vector<slot> table;
+
+      slot &at(const K &k) {
+        return table[hash(k) % slots];
+      }
+
+      void invalidate(const K &k) {
+        slot &s = at(k);
+        if (s.used && s.key == k) s.used = false;
+      }
+
+    public:
+      explicit Find_Cache(const std::string &fn) : river(fn) {
+        table.resize(slots);
+      }
+
+      void insert(const K &k, V v) {
+        invalidate(k);
+        river.insert(k, v);
+      }
+
+      void remove(const K &k, V v) {
+        invalidate(k);
+        river.remove(k, v);
+      }
+
+      void find(const K &k, vector<V> &v) {
+        slot &s = at(k);
+        if (s.used && s.key == k) {
+          ++hits;
+          for (size_t i = 0; i < s.values.size(); ++i) v.push_back(s.values[i]);
+          return;
+        }
+        ++misses;
+        size_t first = v.size();
+        river.find(k, v);
+        if (v.size() - first > max_values) return;
+        s.used = true;
+        s.key = k;
+        s.values.clear();
+        for (size_t i = first; i < v.size(); ++i) s.values.push_back(v[i]);
+      }
+
+      double hit_rate() const {
+        return hits + misses == 0 ? 0 : (double) hits / (hits + misses);
+      }
+
+      void clear() {
+        for (size_t i = 0; i < slots; ++i) table[i].used = false;
+        river.clear();
+      }
+    };
+
+}
+
+#endif //BPTREE_FINDCACHE_H
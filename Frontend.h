@@ -0,0 +1,425 @@
+#ifndef BPTREE_FRONTEND_H
+#define BPTREE_FRONTEND_H
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "utility.h"
+#include "Queue.h"
+
+namespace arima_kana {
+
+    /// @Input
+    /// a byte source read in large chunks,
+    /// with a whitespace tokenizer and an integer parser
+    class Input {
+      static constexpr size_t BUF = 1 << 16;
+
+      FILE *f;
+      vector<char> buf;
+      size_t len = 0, pos = 0;
+
+      bool fill() {
+        if (pos < len) return true;
+        len = fread(&buf[0], 1, BUF, f);
+        pos = 0;
+        return len > 0;
+      }
+
+    public:
+      explicit Input(FILE *f) : f(f) {
+        buf.resize(BUF);
+      }
+
+      int peek() {
+        return fill() ? (unsigned char) buf[pos] : EOF;
+      }
+
+      int get() {
+        return fill() ? (unsigned char) buf[pos++] : EOF;
+      }
+
+      /// the next whitespace-separated token, cut to cap - 1 bytes
+      bool token(char *out, size_t cap) {
+        int c;
+        while ((c = peek()) != EOF && c <= ' ') ++pos;
+        if (c == EOF) return false;
+        size_t n = 0;
+        while ((c = peek()) != EOF && c > ' ') {
+          if (n + 1 < cap) out[n++] = char(c);
+          ++pos;
+        }
+        out[n] = '\0';
+        return true;
+      }
+
+      template<class Int>
+      bool integer(Int &x) {
+        int c;
+        while ((c = peek()) != EOF && c <= ' ') ++pos;
+        if (c == EOF) return false;
+        bool neg = c == '-';
+        if (neg) ++pos;
+        x = 0;
+        while ((c = peek()) >= '0' && c <= '9') {
+          x = x * 10 + (c - '0');
+          ++pos;
+        }
+        if (neg) x = -x;
+        return true;
+      }
+
+      bool bytes(void *dst, size_t n) {
+        auto out = static_cast<char *>(dst);
+        while (n > 0) {
+          if (!fill()) return false;
+          size_t m = len - pos < n ? len - pos : n;
+          memcpy(out, &buf[pos], m);
+          out += m, pos += m, n -= m;
+        }
+        return true;
+      }
+    };
+
+    /// @Output
+    /// a byte sink written in large chunks,
+    /// with integer formatting that does not go through iostreams
+    class Output {
+      static constexpr size_t BUF = 1 << 16;
+
+      FILE *f;
+      vector<char> buf;
+      size_t len = 0;
+
+    public:
+      explicit Output(FILE *f) : f(f) {
+        buf.resize(BUF);
+      }
+
+      ~Output() {
+        flush();
+      }
+
+      void put(char c) {
+        if (len == BUF) flush();
+        buf[len++] = c;
+      }
+
+      void write(const void *src, size_t n) {
+        auto in = static_cast<const char *>(src);
+        while (n > 0) {
+          if (len == BUF) flush();
+          size_t m = BUF - len < n ? BUF - len : n;
+          memcpy(&buf[len], in, m);
+          len += m, in += m, n -= m;
+        }
+      }
+
+      template<class Int>
+      void integer(Int x) {
+        char tmp[24];
+        size_t n = 0;
+        auto u = static_cast<std::make_unsigned_t<Int>>(x);
+        if constexpr (std::is_signed_v<Int>) {
+          if (x < 0) {
+            put('-');
+            u = 0 - u;
+          }
+        }
+        do {
+          tmp[n++] = char('0' + u % 10);
+          u /= 10;
+        } while (u != 0);
+        if (len + n > BUF) flush();
+        while (n > 0) buf[len++] = tmp[--n];
+      }
+
+      void flush() {
+        if (len != 0) fwrite(&buf[0], 1, len, f);
+        fflush(f);
+        len = 0;
+      }
+    };
+
+    /// @command one request of either front-end
+    template<class K, class V>
+    struct command {
+      typedef V value_type;
+
+      enum type : uint8_t {
+        QUIT = 0, INSERT = 1, REMOVE = 2, FIND = 3, CLEAR = 4, PRINT = 5, SKIP = 6
+      };
+
+      type op;
+      K key;
+      V value;
+    };
+
+    /// @Text_Protocol
+    /// the command count on the first line, then one command per line:
+    /// insert <key> <value>, delete <key> <value>, find <key>, clear, print or quit.
+    /// find answers with its values, each followed by a space, on one line
+    template<class K, class V>
+    class Text_Protocol {
+      Input &in;
+      size_t left = 0;
+
+    public:
+      typedef command<K, V> cmd;
+
+      explicit Text_Protocol(Input &in) : in(in) {
+        if (!in.integer(left)) left = 0;
+      }
+
+      bool read(cmd &c) {
+        char op[16];
+        if (left == 0 || !in.token(op, sizeof(op))) return false;
+        --left;
+        c.op = cmd::SKIP;
+        if (strcmp(op, "print") == 0) c.op = cmd::PRINT;
+        else if (strcmp(op, "quit") == 0) c.op = cmd::QUIT;
+        else if (strcmp(op, "clear") == 0) c.op = cmd::CLEAR;
+        else {
+          in.token(c.key.id, sizeof(c.key.id));
+          if (strcmp(op, "insert") == 0) c.op = cmd::INSERT;
+          else if (strcmp(op, "delete") == 0) c.op = cmd::REMOVE;
+          else if (strcmp(op, "find") == 0) c.op = cmd::FIND;
+          if (c.op == cmd::INSERT || c.op == cmd::REMOVE) in.integer(c.value);
+        }
+        return true;
+      }
+
+      static void answer(Output &out, const V *res, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+          out.integer(res[i]);
+          out.put(' ');
+        }
+        out.put('\n');
+      }
+    };
+
+    /// @Binary_Protocol
+    /// a stream of records: op (1 byte, see command::type),
+    /// then for insert, delete and find the key length (1 byte) and the key bytes,
+    /// then for insert and delete the value (sizeof(V) bytes, host order).
+    /// find answers with a 4-byte count followed by the values
+    template<class K, class V>
+    class Binary_Protocol {
+      Input &in;
+
+    public:
+      typedef command<K, V> cmd;
+
+      explicit Binary_Protocol(Input &in) : in(in) {}
+
+      bool read(cmd &c) {
+        int op = in.get();
+        if (op == EOF) return false;
+        c.op = typename cmd::type(op);
+        if (c.op == cmd::INSERT || c.op == cmd::REMOVE || c.op == cmd::FIND) {
+          int n = in.get();
+          if (n == EOF || size_t(n) >= sizeof(c.key.id) || !in.bytes(c.key.id, n)) return false;
+          memset(c.key.id + n, 0, sizeof(c.key.id) - n);
+        }
+        if (c.op == cmd::INSERT || c.op == cmd::REMOVE) {
+          if (!in.bytes(&c.value, sizeof(V))) return false;
+        }
+        return true;
+      }
+
+      static void write(Output &out, const cmd &c) {
+        out.put(char(c.op));
+        if (c.op == cmd::INSERT || c.op == cmd::REMOVE || c.op == cmd::FIND) {
+          auto n = strnlen(c.key.id, sizeof(c.key.id));
+          out.put(char(n));
+          out.write(c.key.id, n);
+        }
+        if (c.op == cmd::INSERT || c.op == cmd::REMOVE) out.write(&c.value, sizeof(V));
+      }
+
+      static void answer(Output &out, const V *res, size_t n) {
+        auto cnt = uint32_t(n);
+        out.write(&cnt, sizeof(cnt));
+        out.write(res, n * sizeof(V));
+      }
+    };
+
+    /// @serve
+    /// reads commands through the protocol in batches of up to `batch`,
+    /// then applies each batch to the river in order
+    template<class Protocol, class River, size_t batch = 1024>
+    void serve(River &river, Protocol &proto, Output &out) {
+      typedef typename Protocol::cmd cmd;
+      vector<cmd> cmds;
+      cmds.resize(batch);
+      vector<typename cmd::value_type> res;
+      bool more = true;
+      while (more) {
+        size_t n = 0;
+        while (n < batch && (more = proto.read(cmds[n]))) {
+          if (cmds[n++].op == cmd::QUIT) {
+            more = false;
+            break;
+          }
+        }
+        for (size_t i = 0; i < n; ++i) {
+          cmd &c = cmds[i];
+          switch (c.op) {
+            case cmd::INSERT:
+              river.insert(c.key, c.value);
+              break;
+            case cmd::REMOVE:
+              river.remove(c.key, c.value);
+              break;
+            case cmd::FIND:
+              res.clear();
+              river.find(c.key, res);
+              Protocol::answer(out, res.size() == 0 ? nullptr : &res[0], res.size());
+              break;
+            case cmd::CLEAR:
+              river.clear();
+              break;
+            case cmd::PRINT:
+              out.flush();
+              river.print();
+              std::cout.flush();
+              break;
+            default:
+              break;
+          }
+        }
+      }
+    }
+
+    /// @serve_pipelined
+    /// like serve, but parsing and formatting get threads of their own:
+    /// batches go from the parser to the executor (the calling thread)
+    /// to the writer through Spsc_Queues, then back to the parser for reuse,
+    /// so answers keep the order of the commands.
+    /// A print gets a batch to itself and waits for the writer to catch up
+    template<class Protocol, class River, size_t batch = 1024, size_t depth = 8>
+    void serve_pipelined(River &river, Protocol &proto, Output &out) {
+      typedef typename Protocol::cmd cmd;
+      typedef typename cmd::value_type V;
+      struct stage {
+        vector<cmd> cmds;
+        size_t n = 0;
+        vector<V> values;// the answers of the finds, back to back
+        vector<size_t> ends;// where the answer of each find ends in values
+        bool last = false;
+      };
+      vector<stage> stages;
+      stages.resize(depth);
+      Spsc_Queue<stage *, depth> empty, parsed, done;
+      std::mutex mu;
+      std::condition_variable caught_up;
+      size_t written = 0;// batches answered, guarded by mu
+      for (size_t i = 0; i < depth; ++i) {
+        stages[i].cmds.resize(batch);
+        empty.push(&stages[i]);
+      }
+      auto is_print = [](const stage *s) { return s->n == 1 && s->cmds[0].op == cmd::PRINT; };
+
+      std::thread parser([&] {
+        cmd c;
+        bool held = false;// c is a print waiting for a batch of its own
+        while (true) {
+          stage *s = empty.pop();
+          s->n = 0;
+          s->last = false;
+          if (held) {
+            s->cmds[s->n++] = c;
+            held = false;
+            parsed.push(s);
+            continue;
+          }
+          while (s->n < batch) {
+            if (!proto.read(c) || c.op == cmd::QUIT) {
+              s->last = true;
+              break;
+            }
+            if (c.op == cmd::PRINT) {
+              held = true;
+              break;
+            }
+            s->cmds[s->n++] = c;
+          }
+          parsed.push(s);
+          if (s->last) return;
+        }
+      });
+
+      std::thread writer([&] {
+        for (bool last = false; !last;) {
+          stage *s = done.pop();
+          last = s->last;
+          size_t from = 0;
+          const V *values = s->values.size() == 0 ? nullptr : &s->values[0];
+          for (size_t i = 0; i < s->ends.size(); ++i) {
+            Protocol::answer(out, values + from, s->ends[i] - from);
+            from = s->ends[i];
+          }
+          if (is_print(s)) out.flush();
+          {
+            std::lock_guard<std::mutex> lk(mu);
+            ++written;
+          }
+          caught_up.notify_one();
+          if (!last) empty.push(s);
+        }
+        out.flush();
+      });
+
+      size_t passed = 0;
+      for (bool last = false; !last;) {
+        stage *s = parsed.pop();
+        last = s->last;
+        s->values.clear();
+        s->ends.clear();
+        if (is_print(s)) {
+          done.push(s);
+          ++passed;
+          {
+            std::unique_lock<std::mutex> lk(mu);
+            caught_up.wait(lk, [&] { return written == passed; });
+          }
+          river.print();
+          std::cout.flush();
+          continue;
+        }
+        for (size_t i = 0; i < s->n; ++i) {
+          cmd &c = s->cmds[i];
+          switch (c.op) {
+            case cmd::INSERT:
+              river.insert(c.key, c.value);
+              break;
+            case cmd::REMOVE:
+              river.remove(c.key, c.value);
+              break;
+            case cmd::FIND:
+              river.find(c.key, s->values);
+              s->ends.push_back(s->values.size());
+              break;
+            case cmd::CLEAR:
+              river.clear();
+              break;
+            default:
+              break;
+          }
+        }
+        done.push(s);
+        ++passed;
+      }
+      parser.join();
+      writer.join();
+    }
+
+}
+
+#endif //BPTREE_FRONTEND_H
@@ -0,0 +1,299 @@
+#ifndef BPTREE_HASHINDEX_H
+#define BPTREE_HASHINDEX_H
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "utility.h"
+#include "Buffer.h"
+
+namespace arima_kana {
+
+    /// @Hash_Index
+    /// a persistent extendible hash from hash(k) to the data blocks holding k.
+    /// Each entry counts the pairs of one key hash in one block,
+    /// so a block is dropped exactly when its last such pair leaves.
+    /// Buckets are page-sized and live in name + "_hash";
+    /// a bucket whose entries cannot be told apart by splitting grows an overflow chain.
+    /// The directory is kept in name + "_hdir", with the number of data blocks
+    /// indexed; a directory that does not match the data is not loaded.
+    template<class K, size_t page = 4096, bool enabled = true>
+    class Hash_Index {
+    public:
+      static constexpr bool ENABLED = true;
+
+      struct entry {
+        uint64_t h;
+        size_t block;
+        size_t count;
+      };
+
+      static constexpr size_t ENTRIES = (page - 3 * sizeof(size_t)) / sizeof(entry);
+      static constexpr size_t MAX_DEPTH = 32;
+
+      struct bucket {
+        size_t depth = 0;
+        size_t size = 0;
+        size_t next = 0;// overflow page, 0 for none
+        entry e[ENTRIES];
+      };
+
+      size_t probes = 0;// bucket pages read by for_each_block
+      size_t blocks = 0;// data blocks indexed, kept up to date by the river
+
+    private:
+      size_t depth = 0;
+      size_t page_num = 0;
+      size_t free_page = 0;// free pages are linked through next
+      vector<size_t> dir;
+      std::string dir_name;
+      bool _loaded = false;
+      List_Map_Buffer<bucket, size_t, 0, 1024> pages;
+
+      size_t slot(uint64_t h) const {
+        return h & ((size_t(1) << depth) - 1);
+      }
+
+      size_t new_page() {
+        size_t id;
+        if (free_page != 0) {
+          id = free_page;
+          free_page = pages[id].next;
+        } else {
+          id = ++page_num;
+        }
+        pages[id] = bucket();
+        return id;
+      }
+
+      /// appends e to the chain starting at id, growing it if needed
+      void put(size_t id, const entry &e) {
+        while (true) {
+          const bucket &b = pages.get(id);
+          if (b.size < ENTRIES) {
+            bucket &w = pages[id];
+            w.e[w.size++] = e;
+            return;
+          }
+          if (b.next == 0) break;
+          id = b.next;
+        }
+        size_t d = pages.get(id).depth;
+        size_t np = new_page();
+        bucket &nb = pages[np];
+        nb.depth = d;
+        nb.e[0] = e;
+        nb.size = 1;
+        pages[id].next = np;
+      }
+
+      /// splits the bucket chain of directory slot s in two
+      void split(size_t s) {
+        size_t id = dir[s];
+        size_t d = pages.get(id).depth;
+        if (d == depth) {
+          for (size_t i = 0, n = dir.size(); i < n; ++i) dir.push_back(dir[i]);
+          ++depth;
+        }
+        vector<entry> all;
+        size_t next = 0;
+        {
+          bucket &b = pages[id];
+          for (size_t i = 0; i < b.size; ++i) all.push_back(b.e[i]);
+          next = b.next;
+          b = bucket();
+          b.depth = d + 1;
+        }
+        while (next != 0) {
+          bucket &b = pages[next];
+          for (size_t i = 0; i < b.size; ++i) all.push_back(b.e[i]);
+          size_t cur = next;
+          next = b.next;
+          b.size = 0;
+          b.next = free_page;
+          free_page = cur;
+        }
+        size_t id2 = new_page();
+        pages[id2].depth = d + 1;
+        for (size_t i = 0; i < dir.size(); ++i) {
+          if (dir[i] == id && (i >> d & 1)) dir[i] = id2;
+        }
+        for (size_t i = 0; i < all.size(); ++i) put(dir[slot(all[i].h)], all[i]);
+      }
+
+      /// a directory cut short or written in another format is not loaded
+      void read_dir() {
+        std::fstream f(dir_name, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!f.is_open()) return;
+        size_t len = size_t(f.tellg()), n = 0;
+        f.seekg(0);
+        f.read(reinterpret_cast<char *>(&depth), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&page_num), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&free_page), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&blocks), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+        if (!f || len != (5 + n) * sizeof(size_t)) return;
+        dir.resize(n);
+        for (size_t i = 0; i < n; ++i) f.read(reinterpret_cast<char *>(&dir[i]), sizeof(size_t));
+        _loaded = true;
+      }
+
+      void write_dir() {
+        std::fstream f(dir_name, std::ios::out | std::ios::binary);
+        size_t n = dir.size();
+        f.write(reinterpret_cast<char *>(&depth), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&page_num), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&free_page), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&blocks), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+        for (size_t i = 0; i < n; ++i) f.write(reinterpret_cast<char *>(&dir[i]), sizeof(size_t));
+      }
+
+    public:
+      explicit Hash_Index(const std::string &fn) : dir_name(fn + "_hdir"), pages(fn + "_hash") {
+        read_dir();
+        if (!_loaded) clear();
+      }
+
+      ~Hash_Index() {
+        write_dir();
+      }
+
+      /// @checkpoint writes the directory and the cached buckets back
+      void checkpoint() {
+        write_dir();
+        pages.checkpoint();
+      }
+
+      /// whether the index was read back rather than started empty,
+      /// indexing as many data blocks as the data file holds
+      bool loaded(size_t data_blocks) const {
+        return _loaded && blocks == data_blocks;
+      }
+
+      void add(uint64_t h, size_t block, size_t count = 1) {
+        size_t id = dir[slot(h)], room = 0;
+        bool distinct = false;
+        for (size_t p = id; p != 0;) {
+          const bucket &b = pages.get(p);
+          for (size_t i = 0; i < b.size; ++i) {
+            if (b.e[i].h == h && b.e[i].block == block) {
+              pages[p].e[i].count += count;
+              return;
+            }
+            if (b.e[i].h != h) distinct = true;
+          }
+          if (room == 0 && b.size < ENTRIES) room = p;
+          p = b.next;
+        }
+        if (room != 0) {
+          bucket &b = pages[room];
+          b.e[b.size++] = {h, block, count};
+          return;
+        }
+        if (distinct && pages.get(id).depth < MAX_DEPTH) {
+          split(slot(h));
+          add(h, block, count);
+          return;
+        }
+        put(id, {h, block, count});
+      }
+
+      void remove(uint64_t h, size_t block, size_t count = 1) {
+        for (size_t p = dir[slot(h)]; p != 0;) {
+          const bucket &b = pages.get(p);
+          for (size_t i = 0; i < b.size; ++i) {
+            if (b.e[i].h == h && b.e[i].block == block) {
+              bucket &w = pages[p];
+              if (w.e[i].count > count) w.e[i].count -= count;
+              else w.e[i] = w.e[--w.size];
+              return;
+            }
+          }
+          p = b.next;
+        }
+      }
+
+      /// @add_block indexes every pair of a data block
+      template<class Node>
+      void add_block(size_t block, const Node &node) {
+        for (size_t i = 0, j; i < node.size; i = j) {
+          for (j = i + 1; j < node.size && node._data.key(j) == node._data.key(i); ++j);
+          add(hash(node._data.key(i)), block, j - i);
+        }
+      }
+
+      /// @move_block
+      /// the pairs of node have moved from block `from` to block `to`
+      template<class Node>
+      void move_block(size_t from, size_t to, const Node &node) {
+        for (size_t i = 0, j; i < node.size; i = j) {
+          for (j = i + 1; j < node.size && node._data.key(j) == node._data.key(i); ++j);
+          uint64_t h = hash(node._data.key(i));
+          remove(h, from, j - i);
+          add(h, to, j - i);
+        }
+      }
+
+      /// calls fn(block) for every block holding a key hashed to h, in no particular order
+      template<class F>
+      void for_each_block(uint64_t h, F &&fn) {
+        for (size_t p = dir[slot(h)]; p != 0;) {
+          ++probes;
+          const bucket &b = pages.get(p);
+          for (size_t i = 0; i < b.size; ++i) {
+            if (b.e[i].h == h) fn(b.e[i].block);
+          }
+          p = b.next;
+        }
+      }
+
+      void clear() {
+        pages.clear();
+        std::fstream(pages.name, std::ios::out | std::ios::binary);
+        blocks = 0;
+        depth = 0;
+        page_num = 0;
+        free_page = 0;
+        dir.clear();
+        dir.push_back(new_page());
+      }
+    };
+
+    /// enabled == false keeps no index
+    template<class K, size_t page>
+    class Hash_Index<K, page, false> {
+    public:
+      static constexpr bool ENABLED = false;
+
+      size_t blocks = 0;
+
+      /// drops the files left by a run with the index,
+      /// since they go stale as soon as blocks change here
+      explicit Hash_Index(const std::string &fn) {
+        std::remove((fn + "_hash").c_str());
+        std::remove((fn + "_hdir").c_str());
+      }
+
+      bool loaded(size_t) const { return true; }
+
+      template<class Node>
+      void add_block(size_t, const Node &) {}
+
+      template<class Node>
+      void move_block(size_t, size_t, const Node &) {}
+
+      void add(uint64_t, size_t, size_t = 1) {}
+
+      void remove(uint64_t, size_t, size_t = 1) {}
+
+      void checkpoint() {}
+
+      void clear() {}
+    };
+
+}
+
+#endif //BPTREE_HASHINDEX_H
@@ -0,0 +1,96 @@
+#ifndef BPTREE_LAYOUT_H
+#define BPTREE_LAYOUT_H
+#pragma once
+
+#include <cstddef>
+#include "utility.h"
+
+namespace arima_kana {
+
+    /// @aos_layout
+    /// array-of-structures page layout,
+    /// every slot stores a whole pair<K, V>
+    struct aos_layout {
+      static constexpr size_t align = alignof(size_t);
+
+      template<class K, class V, size_t n>
+      struct storage {
+        typedef pair<K, V> p;
+
+        p _kv[n];
+
+        const K &key(size_t i) const { return _kv[i].first; }
+
+        const V &value(size_t i) const { return _kv[i].second; }
+
+        V &value(size_t i) { return _kv[i].second; }
+
+        p get(size_t i) const { return _kv[i]; }
+
+        void set(size_t i, const p &kv) { _kv[i] = kv; }
+
+        void assign(size_t i, const storage &other, size_t j) { _kv[i] = other._kv[j]; }
+
+        void move(size_t dst, size_t src) { _kv[dst] = _kv[src]; }
+      };
+    };
+
+    /// @soa_layout
+    /// structure-of-arrays page layout,
+    /// keys and values live in separate cache-line aligned arrays
+    /// so that searches only touch the keys
+    struct soa_layout {
+      static constexpr size_t align = 64;
+
+      template<class K, class V, size_t n>
+      struct storage {
+        typedef pair<K, V> p;
+
+        alignas(align) K _k[n];
+        alignas(align) V _v[n];
+
+        const K &key(size_t i) const { return _k[i]; }
+
+        const V &value(size_t i) const { return _v[i]; }
+
+        V &value(size_t i) { return _v[i]; }
+
+        p get(size_t i) const { return p(_k[i], _v[i]); }
+
+        void set(size_t i, const p &kv) {
+          _k[i] = kv.first;
+          _v[i] = kv.second;
+        }
+
+        void assign(size_t i, const storage &other, size_t j) {
+          _k[i] = other._k[j];
+          _v[i] = other._v[j];
+        }
+
+        void move(size_t dst, size_t src) {
+          _k[dst] = _k[src];
+          _v[dst] = _v[src];
+        }
+      };
+    };
+
+    /// comparisons between a stored slot and a pair,
+    /// shared by all layouts
+    template<class S, class K, class V>
+    bool slot_less(const S &s, size_t i, const pair<K, V> &kv) {
+      return s.key(i) < kv.first || (s.key(i) == kv.first && s.value(i) < kv.second);
+    }
+
+    template<class S, class K, class V>
+    bool slot_greater(const S &s, size_t i, const pair<K, V> &kv) {
+      return kv.first < s.key(i) || (kv.first == s.key(i) && kv.second < s.value(i));
+    }
+
+    template<class S, class K, class V>
+    bool slot_equal(const S &s, size_t i, const pair<K, V> &kv) {
+      return s.key(i) == kv.first && s.value(i) == kv.second;
+    }
+
+}
+
+#endif //BPTREE_LAYOUT_H
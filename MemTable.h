@@ -0,0 +1,111 @@
+#ifndef BPTREE_MEMTABLE_H
+#define BPTREE_MEMTABLE_H
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "utility.h"
+#include "map.h"
+
+namespace arima_kana {
+
+    /// @Mem_Table
+    /// a sorted in-memory write buffer in front of a BlockRiver.
+    /// insert and remove only touch the table, a removal is kept as a tombstone;
+    /// once `capacity` pairs are buffered they are applied to the river
+    /// in (key, value) order, so neighbouring updates hit the same data block.
+    /// find merges the buffered pairs with the ones on disk.
+    template<class River, size_t capacity = 4096>
+    class Mem_Table {
+    public:
+      typedef typename River::KV KV;
+      typedef decltype(KV::first) K;
+      typedef decltype(KV::second) V;
+
+      /// value -> true for an insertion, false for a tombstone
+      typedef map<V, bool> entry;
+
+      River river;
+      size_t flushes = 0;
+
+    private:
+      map<K, entry> table;
+      size_t buffered = 0;
+
+      void put(const K &k, const V &v, bool live) {
+        entry &e = table[k];
+        size_t before = e.size();
+        e[v] = live;
+        if (e.size() != before && ++buffered >= capacity) flush();
+      }
+
+    public:
+      explicit Mem_Table(const std::string &fn) : river(fn) {}
+
+      ~Mem_Table() {
+        flush();
+      }
+
+      void insert(const K &k, const V &v) {
+        put(k, v, true);
+      }
+
+      void remove(const K &k, const V &v) {
+        put(k, v, false);
+      }
+
+      /// @flush applies the buffered pairs to the river in sorted order
+      void flush() {
+        if (buffered == 0) return;
+        for (auto it = table.cbegin(); it != table.cend(); ++it) {
+          for (auto e = it->second.cbegin(); e != it->second.cend(); ++e) {
+            V v = e->first;
+            if (e->second) river.insert(it->first, v);
+            else river.remove(it->first, v);
+          }
+        }
+        table.clear();
+        buffered = 0;
+        ++flushes;
+      }
+
+      /// number of pairs waiting for the next flush
+      size_t pending() const {
+        return buffered;
+      }
+
+      void find(const K &k, vector<V> &v) {
+        auto it = table.find(k);
+        if (it == table.end()) {
+          river.find(k, v);
+          return;
+        }
+        const entry &e = it->second;
+        auto m = e.cbegin();
+        river.for_each(k, [&](const V &d) {
+          while (m != e.cend() && m->first < d) {
+            if (m->second) v.push_back(m->first);
+            ++m;
+          }
+          if (m != e.cend() && !(d < m->first)) {
+            if (m->second) v.push_back(d);
+            ++m;
+          } else {
+            v.push_back(d);
+          }
+        });
+        for (; m != e.cend(); ++m) {
+          if (m->second) v.push_back(m->first);
+        }
+      }
+
+      void clear() {
+        table.clear();
+        buffered = 0;
+        river.clear();
+      }
+    };
+
+}
+
+#endif //BPTREE_MEMTABLE_H
@@ -0,0 +1,85 @@
+#ifndef BPTREE_PAGE_H
+#define BPTREE_PAGE_H
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include "Layout.h"
+#include "BNode.h"
+#include "DataNode.h"
+
+namespace arima_kana {
+
+    constexpr size_t round_up(size_t x, size_t a) {
+      return (x + a - 1) / a * a;
+    }
+
+    /// @page_frame
+    /// T padded and aligned to a whole number of pages,
+    /// so a node never straddles two device pages
+    template<class T, size_t page>
+    struct alignas(T) alignas(page) page_frame : public T {
+      using T::T;
+    };
+
+    /// page == 0 keeps the node unpadded
+    template<class T, size_t page>
+    using paged = std::conditional_t<page == 0, T, page_frame<T, page>>;
+
+    /// @page_header
+    /// bytes taken by a file header of `words` size_t's,
+    /// rounded up so that the nodes behind it stay aligned
+    template<class T>
+    constexpr size_t page_header(size_t words) {
+      return round_up(words * sizeof(size_t), alignof(T));
+    }
+
+    /// @page_offset
+    /// file offset of the pos-th (1-based) node
+    template<class T>
+    constexpr size_t page_offset(size_t words, size_t pos) {
+      return page_header<T>(words) + (pos - 1) * sizeof(T);
+    }
+
+    /// @max_fit
+    /// the largest n in [lo, hi] such that sizeof(F::node<n>) <= page
+    template<class F, size_t page, size_t lo, size_t hi, bool = (lo >= hi)>
+    struct max_fit {
+      static constexpr size_t value = lo;
+    };
+
+    template<class F, size_t page, size_t lo, size_t hi>
+    struct max_fit<F, page, lo, hi, false> {
+      static constexpr size_t mid = (lo + hi + 1) / 2;
+      static constexpr size_t value =
+              std::conditional_t<(sizeof(typename F::template node<mid>) <= page),
+                      max_fit<F, page, mid, hi>, max_fit<F, page, lo, mid - 1>>::value;
+    };
+
+    /// @page_sizing
+    /// derives the node capacities of BPTree and BlockRiver
+    /// from the target page size and the size of the pairs
+    template<class K, class V, size_t page, class Layout = aos_layout>
+    struct page_sizing {
+      static_assert(page >= 512 && (page & (page - 1)) == 0, "page size must be a power of 2");
+
+      struct index_f {
+        template<size_t n>
+        using node = BNode<K, V, n, Layout>;
+      };
+
+      struct data_f {
+        template<size_t n>
+        using node = DataNode<K, V, n, Layout>;
+      };
+
+      static constexpr size_t degree = max_fit<index_f, page, 1, page>::value;
+      static constexpr size_t min_size = degree * 2 / 7;
+      static constexpr size_t block = max_fit<data_f, page, 1, page>::value;
+
+      static_assert(degree >= 8 && block >= 4, "page too small for the key and value types");
+    };
+
+}
+
+#endif //BPTREE_PAGE_H
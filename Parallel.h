@@ -0,0 +1,215 @@
+#ifndef BPTREE_PARALLEL_H
+#define BPTREE_PARALLEL_H
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "utility.h"
+#include "error.h"
+#include "Page.h"
+
+namespace arima_kana {
+
+    inline size_t default_threads() {
+      size_t n = std::thread::hardware_concurrency();
+      return n == 0 ? 1 : n;
+    }
+
+    /// @parallel_for
+    /// splits [0, n) into at most `threads` contiguous slices (0 for one per core)
+    /// and runs fn(slice, lo, hi) for each, the first on the calling thread
+    template<class F>
+    void parallel_for(size_t n, size_t threads, F &&fn) {
+      if (threads == 0) threads = default_threads();
+      if (threads > n) threads = n;
+      if (n == 0) return;
+      vector<std::thread> pool;
+      pool.reserve(threads);
+      for (size_t t = 1; t < threads; ++t) pool.push_back(std::thread([&fn, t, n, threads] {
+          fn(t, n * t / threads, n * (t + 1) / threads);
+        }));
+      fn(0, 0, n / threads);
+      for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+    }
+
+    /// @parallel_sort
+    /// merge sort: the slices are sorted concurrently,
+    /// then neighbouring runs are merged pairwise, also concurrently
+    template<class T>
+    void parallel_sort(T *a, size_t n, size_t threads = 0) {
+      if (threads == 0) threads = default_threads();
+      if (threads > n) threads = n;
+      if (n < 2) return;
+      vector<size_t> bounds;
+      for (size_t t = 0; t <= threads; ++t) bounds.push_back(n * t / threads);
+      parallel_for(threads, threads, [&](size_t, size_t lo, size_t hi) {
+        for (size_t r = lo; r < hi; ++r) std::sort(a + bounds[r], a + bounds[r + 1]);
+      });
+      if (threads == 1) return;
+      vector<T> tmp;
+      tmp.resize(n);
+      T *src = a, *dst = &tmp[0];
+      while (bounds.size() > 2) {
+        size_t runs = bounds.size() - 1, pairs = (runs + 1) / 2;
+        parallel_for(pairs, threads, [&](size_t, size_t lo, size_t hi) {
+          for (size_t i = lo; i < hi; ++i) {
+            size_t l = bounds[2 * i], m = bounds[std::min(2 * i + 1, runs)], r = bounds[std::min(2 * i + 2, runs)];
+            std::merge(src + l, src + m, src + m, src + r, dst + l);
+          }
+        });
+        vector<size_t> next;
+        for (size_t i = 0; i < bounds.size(); i += 2) next.push_back(bounds[i]);
+        if (next[next.size() - 1] != n) next.push_back(n);
+        bounds.clear();
+        for (size_t i = 0; i < next.size(); ++i) bounds.push_back(next[i]);
+        std::swap(src, dst);
+      }
+      if (src != a) {
+        parallel_for(n, threads, [&](size_t, size_t lo, size_t hi) {
+          std::copy(src + lo, src + hi, a + lo);
+        });
+      }
+    }
+
+    /// @parallel_scan
+    /// calls fn(slice, id, block) for every data block of the river;
+    /// the blocks are split into contiguous id ranges, each read
+    /// front to back by its own thread, several blocks per read.
+    /// With direct I/O on, the reads share the O_DIRECT descriptor
+    /// and leave the page cache alone, otherwise each thread has its own stream.
+    /// Cached blocks are flushed first, the river must not change meanwhile
+    template<class River, class F>
+    void parallel_scan(River &river, size_t threads, F &&fn) {
+      static_assert(!River::compressed, "compressed blocks are not laid out by id");
+      typedef typename River::DNode DNode;
+      static constexpr size_t chunk = 16;
+      river.data_list.flush();
+      bool direct = river.data_list.direct();
+      parallel_for(river.block_num, threads, [&](size_t slice, size_t lo, size_t hi) {
+        std::ifstream f;
+        if (!direct) {
+          f.open(river.data_file, std::ios::binary);
+          f.seekg(page_offset<DNode>(1, lo + 1));
+        }
+        std::unique_ptr<DNode[]> t(new DNode[chunk]);
+        for (size_t id = lo + 1; id <= hi; id += chunk) {
+          size_t want = std::min(chunk, hi + 1 - id), got;
+          if (direct) {
+            got = river.data_list.read_nodes(t.get(), id, want);
+          } else {
+            f.read(reinterpret_cast<char *>(t.get()), std::streamsize(want * sizeof(DNode)));
+            got = size_t(f.gcount()) / sizeof(DNode);
+          }
+          for (size_t i = got; i < want; ++i) t[i] = DNode();
+          for (size_t i = 0; i < want; ++i) fn(slice, id + i, static_cast<const DNode &>(t[i]));
+        }
+      });
+    }
+
+    /// @Scan_Stats the result of verify_river
+    struct Scan_Stats {
+      size_t blocks = 0;
+      size_t empty = 0;// blocks left without pairs by removals
+      size_t pairs = 0;
+      bool ordered = true;// every block sorted, the blocks disjoint
+    };
+
+    /// @verify_river
+    /// counts the blocks and pairs of the river with a parallel_scan
+    /// and checks that every block is strictly ascending
+    /// and that no two blocks overlap
+    template<class River>
+    Scan_Stats verify_river(River &river, size_t threads = 0) {
+      typedef typename River::KV KV;
+      if (threads == 0) threads = default_threads();
+      vector<Scan_Stats> part;
+      part.resize(threads);
+      vector<pair<KV, KV>> range;// (min, max) of each non-empty block
+      range.resize(river.block_num + 1);
+      vector<bool> used;
+      used.resize(river.block_num + 1);
+      parallel_scan(river, threads, [&](size_t slice, size_t id, const typename River::DNode &t) {
+        Scan_Stats &s = part[slice];
+        ++s.blocks;
+        s.pairs += t.size;
+        if (t.size == 0) {
+          ++s.empty;
+          return;
+        }
+        for (size_t i = 1; i < t.size; ++i) {
+          if (!slot_less(t._data, i - 1, t._data.get(i))) s.ordered = false;
+        }
+        range[id] = pair<KV, KV>(t._data.get(0), t.max_pair());
+        used[id] = true;
+      });
+      Scan_Stats res;
+      for (size_t i = 0; i < threads; ++i) {
+        res.blocks += part[i].blocks;
+        res.empty += part[i].empty;
+        res.pairs += part[i].pairs;
+        res.ordered = res.ordered && part[i].ordered;
+      }
+      vector<pair<KV, KV>> live;
+      for (size_t id = 1; id <= river.block_num; ++id) {
+        if (used[id]) live.push_back(range[id]);
+      }
+      if (live.size() > 1) parallel_sort(&live[0], live.size(), threads);
+      for (size_t i = 1; i < live.size(); ++i) {
+        if (!(live[i - 1].second < live[i].first)) res.ordered = false;
+      }
+      return res;
+    }
+
+    /// @bulk_build
+    /// replaces the contents of the river by pairs (which get sorted):
+    /// parallel_sort, duplicates dropped, then the data blocks are packed
+    /// 3/4 full and written by parallel threads straight to the data file
+    /// (through its O_DIRECT descriptor in direct mode),
+    /// and the index is built bottom-up over their maxima
+    template<class River>
+    void bulk_build(River &river, vector<typename River::KV> &pairs, size_t threads = 0) {
+      static_assert(!River::compressed, "compressed blocks are not laid out by id");
+      typedef typename River::KV KV;
+      typedef typename River::DNode DNode;
+      river.clear();
+      if (pairs.size() == 0) return;
+      KV *a = &pairs[0];
+      parallel_sort(a, pairs.size(), threads);
+      size_t n = std::unique(a, a + pairs.size()) - a;
+      static constexpr size_t per = River::block * 3 / 4 == 0 ? 1 : River::block * 3 / 4;
+      size_t nb = (n + per - 1) / per;
+      vector<KV> maxes;
+      maxes.resize(nb);
+      bool direct = river.data_list.direct();
+      parallel_for(nb, threads, [&](size_t, size_t lo, size_t hi) {
+        std::fstream f;
+        if (!direct) {
+          f.open(river.data_file, std::ios::in | std::ios::out | std::ios::binary);
+          f.seekp(page_offset<DNode>(1, lo + 1));
+        }
+        std::unique_ptr<DNode> t(new DNode());
+        for (size_t b = lo; b < hi; ++b) {
+          size_t from = b * per, to = std::min(from + per, n);
+          t->size = to - from;
+          for (size_t i = from; i < to; ++i) t->set_pair(i - from, a[i]);
+          if (direct) {
+            // the river's O_DIRECT descriptor, as its header and blocks go through it
+            auto off = off_t(page_offset<DNode>(1, b + 1));
+            if (pwrite(river.data_list.fd, t.get(), sizeof(DNode), off) != long(sizeof(DNode))) {
+              error("write failed: " + river.data_file);
+            }
+          } else {
+            f.write(reinterpret_cast<char *>(t.get()), sizeof(DNode));
+          }
+          maxes[b] = a[to - 1];
+        }
+      });
+      river.adopt_blocks(nb, [&](size_t i) { return maxes[i]; });
+    }
+
+}
+
+#endif //BPTREE_PARALLEL_H
@@ -0,0 +1,268 @@
+#ifndef BPTREE_POSTING_H
+#define BPTREE_POSTING_H
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include "utility.h"
+#include "error.h"
+#include "Buffer.h"
+#include "Compress.h"
+#include "BlockRiver.h"
+
+namespace arima_kana {
+
+    /// @Posting_Page
+    /// a run of sorted values: the first one zigzag-varint coded,
+    /// every other one as the varint delta to its predecessor
+    template<size_t page>
+    struct Posting_Page {
+      static constexpr size_t CAPACITY = page - 2 * sizeof(size_t);
+
+      size_t next = 0;// next page of the list, 0 for none
+      uint32_t count = 0;
+      uint32_t bytes = 0;
+      char data[CAPACITY];
+    };
+
+    /// @Posting_River
+    /// a multimap from K to integral V keeping each distinct key once:
+    /// the directory (a BlockRiver<K, size_t> in fn) maps a key
+    /// to the head of its posting list, a chain of Posting_Pages in fn + "_post"
+    /// holding its values in ascending order.
+    /// The head page of a list never moves while the list is non-empty.
+    template<class K, class V, size_t page = 4096>
+    class Posting_River {
+      static_assert(std::is_integral_v<V>, "posting lists delta-code integral values");
+      static_assert(page >= 64, "posting page too small");
+
+    public:
+      typedef pair<K, V> KV;
+      typedef Posting_Page<page> post;
+      typedef vector<V, allocator<V>, 64> run;
+
+      BlockRiver<K, size_t> dir;
+
+    private:
+      static constexpr size_t HEADER = 2;// page_num, free_page
+
+      size_t page_num = 0;
+      size_t free_page = 0;// free pages are linked through next
+      std::string post_file;
+      List_Map_Buffer<post, size_t, HEADER, 1024> pages;
+
+      static uint64_t zigzag(V v) {
+        auto x = static_cast<int64_t>(v);
+        return uint64_t(x) << 1 ^ uint64_t(x >> 63);
+      }
+
+      static V unzigzag(uint64_t x) {
+        return static_cast<V>(int64_t(x >> 1 ^ (~(x & 1) + 1)));
+      }
+
+      static void decode(const post &p, run &out) {
+        const char *ip = p.data, *end = p.data + p.bytes;
+        uint64_t cur = 0;
+        for (uint32_t i = 0; i < p.count; ++i) {
+          uint64_t x = get_varint(ip, end);
+          cur = i == 0 ? uint64_t(int64_t(unzigzag(x))) : cur + x;
+          out.push_back(static_cast<V>(cur));
+        }
+      }
+
+      /// codes values [lo, hi) of vals, false if they do not fit in a page
+      static bool encode(const run &vals, size_t lo, size_t hi, post &p) {
+        std::string out;
+        for (size_t i = lo; i < hi; ++i) {
+          put_varint(out, i == lo ? zigzag(vals[i]) : uint64_t(int64_t(vals[i])) - uint64_t(int64_t(vals[i - 1])));
+        }
+        if (out.size() > post::CAPACITY) return false;
+        memcpy(p.data, out.data(), out.size());
+        p.count = uint32_t(hi - lo);
+        p.bytes = uint32_t(out.size());
+        return true;
+      }
+
+      size_t new_page() {
+        size_t id;
+        if (free_page != 0) {
+          id = free_page;
+          free_page = pages[id].next;
+        } else {
+          id = ++page_num;
+        }
+        pages[id] = post();
+        return id;
+      }
+
+      void release_page(size_t id) {
+        post &p = pages[id];
+        p.count = p.bytes = 0;
+        p.next = free_page;
+        free_page = id;
+      }
+
+      /// writes the sorted vals back to page id,
+      /// splitting them over new pages behind it if they outgrow it
+      void store(size_t id, const run &vals) {
+        size_t lo = 0;
+        while (true) {
+          size_t hi = vals.size();
+          post tmp;
+          while (!encode(vals, lo, hi, tmp)) hi = lo + (hi - lo) / 2;
+          post &p = pages[id];
+          tmp.next = p.next;
+          p = tmp;
+          if (hi == vals.size()) return;
+          size_t np = new_page();
+          pages[np].next = pages[id].next;
+          pages[id].next = np;
+          id = np;
+          lo = hi;
+        }
+      }
+
+      /// head page of k, 0 if k has no values
+      size_t head(const K &k) {
+        size_t h = 0;
+        dir.for_each(k, [&h](const size_t &id) {
+          h = id;
+          return false;
+        });
+        return h;
+      }
+
+      /// the page of the list starting at h whose run should hold v,
+      /// prev is set to the page in front of it (0 for the head)
+      size_t locate(size_t h, const V &v, size_t &prev) {
+        size_t id = h;
+        prev = 0;
+        while (true) {
+          size_t next = pages.get(id).next;
+          if (next == 0) return id;
+          const post &p = pages.get(next);
+          const char *ip = p.data;
+          if (p.count == 0 || v < unzigzag(get_varint(ip, p.data + p.bytes))) return id;
+          prev = id, id = next;
+        }
+      }
+
+      void init_post() {
+        std::fstream f(post_file, std::ios::out | std::ios::binary);
+        f.write(reinterpret_cast<char *>(&page_num), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&free_page), sizeof(size_t));
+      }
+
+    public:
+      explicit Posting_River(const std::string &fn) :
+              dir(fn),
+              post_file(fn + "_post"),
+              pages(fn + "_post") {
+        std::fstream f(post_file, std::ios::in | std::ios::binary);
+        if (!f.is_open() || dir.block_num == 0) {
+          init_post();
+          return;
+        }
+        f.read(reinterpret_cast<char *>(&page_num), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&free_page), sizeof(size_t));
+      }
+
+      ~Posting_River() {
+        std::fstream f(post_file, std::ios::in | std::ios::out | std::ios::binary);
+        f.write(reinterpret_cast<char *>(&page_num), sizeof(size_t));
+        f.write(reinterpret_cast<char *>(&free_page), sizeof(size_t));
+      }
+
+      void insert(const K &k, const V &v) {
+        size_t h = head(k);
+        if (h == 0) {
+          h = new_page();
+          run vals;
+          vals.push_back(v);
+          store(h, vals);
+          dir.insert(k, h);
+          return;
+        }
+        size_t prev;
+        size_t id = locate(h, v, prev);
+        run vals;
+        decode(pages.get(id), vals);
+        size_t pos = 0;
+        while (pos < vals.size() && vals[pos] < v) ++pos;
+        if (pos < vals.size() && vals[pos] == v) return;
+        vals.push_back(v);
+        for (size_t i = vals.size() - 1; i > pos; --i) vals[i] = vals[i - 1];
+        vals[pos] = v;
+        store(id, vals);
+      }
+
+      void remove(const K &k, const V &v) {
+        size_t h = head(k);
+        if (h == 0) return;
+        size_t prev;
+        size_t id = locate(h, v, prev);
+        run vals;
+        decode(pages.get(id), vals);
+        size_t pos = 0;
+        while (pos < vals.size() && vals[pos] < v) ++pos;
+        if (pos == vals.size() || vals[pos] != v) return;
+        for (size_t i = pos + 1; i < vals.size(); ++i) vals[i - 1] = vals[i];
+        vals.pop_back();
+        if (!vals.empty()) {
+          store(id, vals);
+          return;
+        }
+        size_t next = pages.get(id).next;
+        if (prev != 0) {
+          pages[prev].next = next;
+          release_page(id);
+        } else if (next != 0) {
+          // keep the head in place, pull the second page into it
+          pages[id] = pages[next];
+          release_page(next);
+        } else {
+          release_page(id);
+          dir.remove(k, h);
+        }
+      }
+
+      /// @for_each
+      /// hands every value of k to fn in ascending order,
+      /// decoding the posting list page by page;
+      /// fn may return false to stop early.
+      /// Returns the number of values visited.
+      template<class F>
+      size_t for_each(const K &k, F &&fn) {
+        size_t cnt = 0;
+        run vals;
+        for (size_t id = head(k); id != 0;) {
+          vals.clear();
+          const post &p = pages.get(id);
+          decode(p, vals);
+          id = p.next;
+          for (size_t i = 0; i < vals.size(); ++i) {
+            ++cnt;
+            if (!visit(fn, static_cast<const V &>(vals[i]))) return cnt;
+          }
+        }
+        return cnt;
+      }
+
+      void find(const K &k, vector<V> &v) {
+        for_each(k, [&v](const V &val) { v.push_back(val); });
+      }
+
+      void clear() {
+        dir.clear();
+        pages.clear();
+        page_num = free_page = 0;
+        init_post();
+      }
+    };
+
+}
+
+#endif //BPTREE_POSTING_H
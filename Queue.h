@@ -0,0 +1,122 @@
+#ifndef BPTREE_QUEUE_H
+#define BPTREE_QUEUE_H
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace arima_kana {
+
+    /// @Spsc_Queue
+    /// a bounded lock-free ring for exactly one producer thread
+    /// and one consumer thread; capacity must be a power of two.
+    /// push and pop spin a little, then sleep until the other side moves
+    template<class T, size_t capacity>
+    class Spsc_Queue {
+      static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+      static constexpr int SPINS = 64;
+
+      T ring[capacity];
+      alignas(64) std::atomic<size_t> head{0};// next slot to pop, owned by the consumer
+      alignas(64) std::atomic<size_t> tail{0};// next slot to push, owned by the producer
+      alignas(64) std::atomic<int> sleepers{0};
+      std::mutex mu;
+      std::condition_variable moved;
+
+      /// wakes a sleeping side after head or tail moved.
+      /// The moves, the sleeper count and the checks of the other index are
+      /// all seq_cst, so either the sleeper sees the move or this sees the sleeper
+      void wake() {
+        if (sleepers.load(std::memory_order_seq_cst) == 0) return;
+        std::lock_guard<std::mutex> lk(mu);
+        moved.notify_all();
+      }
+
+      template<class F>
+      void sleep(F &&ready) {
+        std::unique_lock<std::mutex> lk(mu);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        moved.wait(lk, ready);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+      }
+
+      bool push_slot(const T &x) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_seq_cst) == capacity) return false;
+        ring[t & (capacity - 1)] = x;
+        tail.store(t + 1, std::memory_order_seq_cst);
+        return true;
+      }
+
+      bool pop_slot(T &x) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_seq_cst)) return false;
+        x = std::move(ring[h & (capacity - 1)]);
+        head.store(h + 1, std::memory_order_seq_cst);
+        return true;
+      }
+
+    public:
+      bool try_push(const T &x) {
+        if (!push_slot(x)) return false;
+        wake();
+        return true;
+      }
+
+      bool try_pop(T &x) {
+        if (!pop_slot(x)) return false;
+        wake();
+        return true;
+      }
+
+      /// waits until there is room
+      void push(const T &x) {
+        for (int i = 0; i < SPINS; ++i) {
+          if (try_push(x)) return;
+          std::this_thread::yield();
+        }
+        sleep([&] { return push_slot(x); });
+        wake();
+      }
+
+      /// waits until there is an element
+      T pop() {
+        T x;
+        for (int i = 0; i < SPINS; ++i) {
+          if (try_pop(x)) return x;
+          std::this_thread::yield();
+        }
+        sleep([&] { return pop_slot(x); });
+        wake();
+        return x;
+      }
+    };
+
+    /// @Latch
+    /// a one-shot countdown: wait() blocks until count_down() has been called n times
+    class Latch {
+      std::mutex mu;
+      std::condition_variable zero;
+      size_t left;
+
+    public:
+      explicit Latch(size_t n) : left(n) {}
+
+      void count_down() {
+        std::lock_guard<std::mutex> lk(mu);
+        if (--left == 0) zero.notify_all();
+      }
+
+      void wait() {
+        std::unique_lock<std::mutex> lk(mu);
+        zero.wait(lk, [this] { return left == 0; });
+      }
+    };
+
+}
+
+#endif //BPTREE_QUEUE_H
@@ -0,0 +1,208 @@
+#ifndef BPTREE_SHARD_H
+#define BPTREE_SHARD_H
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "utility.h"
+#include "Queue.h"
+#include "error.h"
+
+namespace arima_kana {
+
+    /// @Sharded_River
+    /// splits the key space over a number of rivers (files fn_shard0, fn_shard1, ...),
+    /// each owned by a worker thread that applies its requests in arrival order.
+    /// A key goes to the shard of the first split greater than it when splits are given,
+    /// otherwise to hash(key) % shards, so all pairs of a key live in one shard.
+    /// insert and remove return once queued; find waits for its shard only,
+    /// find_batch scatters its keys over all shards and gathers the answers.
+    /// The shard count and splits are kept in fn_shards,
+    /// and reopening with others is refused, since keys would be routed elsewhere.
+    /// Requests must come from a single thread.
+    template<class River, size_t depth = 256>
+    class Sharded_River {
+    public:
+      typedef typename River::KV KV;
+      typedef decltype(KV::first) K;
+      typedef decltype(KV::second) V;
+
+    private:
+      enum op_type : uint8_t {
+        INSERT, REMOVE, FIND, CLEAR, DIRECT, SYNC, STOP
+      };
+
+      struct request {
+        op_type op;
+        K key;
+        V value;
+        vector<V> *out;
+        Latch *done;// counted down once the request is applied
+      };
+
+      struct shard {
+        River river;
+        Spsc_Queue<request, depth> queue;
+        std::thread worker;
+        bool direct = false;// set by DIRECT
+
+        explicit shard(const std::string &fn) : river(fn) {}
+      };
+
+      vector<shard *> shards;
+      vector<K> splits;
+
+      static void work(shard *s) {
+        while (true) {
+          request q = s->queue.pop();
+          switch (q.op) {
+            case INSERT:
+              s->river.insert(q.key, q.value);
+              break;
+            case REMOVE:
+              s->river.remove(q.key, q.value);
+              break;
+            case FIND:
+              s->river.find(q.key, *q.out);
+              break;
+            case CLEAR:
+              s->river.clear();
+              break;
+            case DIRECT:
+              s->direct = s->river.use_direct();
+              break;
+            default:
+              break;
+          }
+          if (q.done != nullptr) q.done->count_down();
+          if (q.op == STOP) return;
+        }
+      }
+
+      /// sends op to every shard and waits until all have applied it
+      void broadcast(op_type op) {
+        Latch done(shards.size());
+        for (size_t i = 0; i < shards.size(); ++i) shards[i]->queue.push({op, K(), V(), nullptr, &done});
+        done.wait();
+      }
+
+      static bool same(const K &a, const K &b) {
+        return !(a < b) && !(b < a);
+      }
+
+      /// writes the layout to name, or checks it against the one there
+      void check_layout(const std::string &name, size_t n) {
+        std::fstream f(name, std::ios::in | std::ios::binary);
+        if (!f.is_open()) {
+          f.open(name, std::ios::out | std::ios::binary);
+          size_t m = splits.size();
+          f.write(reinterpret_cast<const char *>(&n), sizeof(size_t));
+          f.write(reinterpret_cast<const char *>(&m), sizeof(size_t));
+          for (size_t i = 0; i < m; ++i) f.write(reinterpret_cast<const char *>(&splits[i]), sizeof(K));
+          return;
+        }
+        size_t stored = 0, m = 0;
+        f.read(reinterpret_cast<char *>(&stored), sizeof(size_t));
+        f.read(reinterpret_cast<char *>(&m), sizeof(size_t));
+        bool match = f && stored == n && m == splits.size();
+        K k;
+        for (size_t i = 0; match && i < m; ++i) {
+          f.read(reinterpret_cast<char *>(&k), sizeof(K));
+          match = f && same(k, splits[i]);
+        }
+        if (!match) {
+          error(name + " holds " + std::to_string(stored) + " shards with " + std::to_string(m)
+                + " splits, opened with " + std::to_string(n) + " and " + std::to_string(splits.size()));
+        }
+      }
+
+    public:
+      /// splits, if any, must be ascending and number shards - 1
+      Sharded_River(const std::string &fn, size_t n, const vector<K> &split_keys = vector<K>()) {
+        if (n == 0) n = 1;
+        for (size_t i = 0; i < split_keys.size(); ++i) splits.push_back(split_keys[i]);
+        check_layout(fn + "_shards", n);
+        for (size_t i = 0; i < n; ++i) shards.push_back(new shard(fn + "_shard" + std::to_string(i)));
+        for (size_t i = 0; i < n; ++i) shards[i]->worker = std::thread(work, shards[i]);
+      }
+
+      ~Sharded_River() {
+        for (size_t i = 0; i < shards.size(); ++i) shards[i]->queue.push({STOP, K(), V(), nullptr, nullptr});
+        for (size_t i = 0; i < shards.size(); ++i) {
+          shards[i]->worker.join();
+          delete shards[i];
+        }
+      }
+
+      size_t size() const {
+        return shards.size();
+      }
+
+      size_t shard_of(const K &k) const {
+        if (splits.size() == 0) return hash(k) % shards.size();
+        size_t l = 0, r = splits.size();
+        while (l < r) {
+          size_t mid = (l + r) / 2;
+          if (k < splits[mid]) r = mid;
+          else l = mid + 1;
+        }
+        return l < shards.size() ? l : shards.size() - 1;
+      }
+
+      void insert(const K &k, const V &v) {
+        shards[shard_of(k)]->queue.push({INSERT, k, v, nullptr, nullptr});
+      }
+
+      void remove(const K &k, const V &v) {
+        shards[shard_of(k)]->queue.push({REMOVE, k, v, nullptr, nullptr});
+      }
+
+      void find(const K &k, vector<V> &v) {
+        Latch done(1);
+        shards[shard_of(k)]->queue.push({FIND, k, V(), &v, &done});
+        done.wait();
+      }
+
+      /// @find_batch appends the values of keys[i] to out[i] for i < n
+      void find_batch(const K *keys, size_t n, vector<V> *out) {
+        if (n == 0) return;
+        Latch done(n);
+        for (size_t i = 0; i < n; ++i) shards[shard_of(keys[i])]->queue.push({FIND, keys[i], V(), &out[i], &done});
+        done.wait();
+      }
+
+      /// @sync returns once every queued request has been applied
+      void sync() {
+        broadcast(SYNC);
+      }
+
+      void clear() {
+        broadcast(CLEAR);
+      }
+
+      /// @use_direct
+      /// moves every shard's files to O_DIRECT (see BlockRiver::use_direct)
+      /// on its worker; false if any shard stays buffered
+      bool use_direct() {
+        broadcast(DIRECT);
+        bool all = true;
+        for (size_t i = 0; i < shards.size(); ++i) all = all && shards[i]->direct;
+        return all;
+      }
+
+      /// the shards one after another, after a sync
+      void print() {
+        sync();
+        for (size_t i = 0; i < shards.size(); ++i) {
+          std::cout << "shard " << i << '\n';
+          shards[i]->river.print();
+        }
+      }
+    };
+
+}
+
+#endif //BPTREE_SHARD_H
@@ -0,0 +1,198 @@
+#ifndef BPTREE_WORKLOAD_H
+#define BPTREE_WORKLOAD_H
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include "utility.h"
+#include "error.h"
+
+namespace arima_kana {
+
+    /// @Zipf_Generator
+    /// ranks in [0, n) with P(i) proportional to 1 / (i + 1) ^ theta,
+    /// by the method of Gray et al. (also used by YCSB);
+    /// n may grow between draws, theta must not be 1
+    class Zipf_Generator {
+      double theta, alpha, zeta2;
+      double zetan = 0, eta = 0;
+      size_t n = 0, eta_n = 0;
+
+    public:
+      explicit Zipf_Generator(double theta) :
+              theta(theta), alpha(1 / (1 - theta)), zeta2(1 + std::pow(0.5, theta)) {}
+
+      void grow(size_t new_n) {
+        while (n < new_n) zetan += 1 / std::pow(double(++n), theta);
+      }
+
+      size_t size() const {
+        return n;
+      }
+
+      template<class Rng>
+      size_t next(Rng &rng) {
+        if (eta_n != n) {
+          eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+          eta_n = n;
+        }
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan;
+        if (uz < 1) return 0;
+        if (uz < zeta2) return n > 1 ? 1 : 0;
+        auto r = size_t(n * std::pow(eta * u - eta + 1, alpha));
+        return r < n ? r : n - 1;
+      }
+    };
+
+    /// @Workload_Config
+    /// a workload as `name=value` arguments, see usage()
+    struct Workload_Config {
+      std::string target = "river";// river or tree
+      std::string dist = "zipf";// zipf or uniform
+      double theta = 0.99;
+      size_t keylen = 16;
+      size_t preload = 200000;
+      size_t ops = 200000;
+      size_t read = 50, insert = 30, remove = 20;// percentages of the mix
+      double dup = 0.5;// share of inserts adding a value to an existing key
+      unsigned seed = 2024;
+      std::string fn = "bench_workload";
+
+      static void usage() {
+        std::cout << "usage: bench [name=value ...]\n"
+                     "  target=river|tree  dist=zipf|uniform  theta=0.99  keylen=16\n"
+                     "  preload=200000  ops=200000  read=50  insert=30  remove=20\n"
+                     "  dup=0.5  seed=2024  fn=bench_workload\n";
+      }
+
+      void set(const std::string &arg) {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) error("expected name=value: " + arg);
+        std::string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+        if (name == "target") target = value;
+        else if (name == "dist") dist = value;
+        else if (name == "theta") theta = std::stod(value);
+        else if (name == "keylen") keylen = std::stoul(value);
+        else if (name == "preload") preload = std::stoul(value);
+        else if (name == "ops") ops = std::stoul(value);
+        else if (name == "read") read = std::stoul(value);
+        else if (name == "insert") insert = std::stoul(value);
+        else if (name == "remove") remove = std::stoul(value);
+        else if (name == "dup") dup = std::stod(value);
+        else if (name == "seed") seed = std::stoul(value);
+        else if (name == "fn") fn = value;
+        else error("unknown workload parameter: " + name);
+      }
+    };
+
+    /// @Workload
+    /// draws the operations of a Workload_Config.
+    /// Key i is given values 0, 1, 2, ... in insertion order,
+    /// so removals can aim at values that were inserted
+    class Workload {
+    public:
+      enum op_type {
+        READ, INSERT, REMOVE
+      };
+
+      struct op {
+        op_type type;
+        size_t key;
+        int value;
+      };
+
+    private:
+      const Workload_Config &cfg;
+      std::mt19937_64 rng;
+      Zipf_Generator zipf;
+      vector<int> values;// values handed out per key
+
+      size_t pick() {
+        size_t n = values.size();
+        if (cfg.dist == "uniform") return rng() % n;
+        size_t rank = zipf.next(rng);
+        // scatter the hot ranks over the key space
+        return hash(rank) % n;
+      }
+
+      size_t new_key() {
+        values.push_back(0);
+        zipf.grow(values.size());
+        return values.size() - 1;
+      }
+
+    public:
+      explicit Workload(const Workload_Config &cfg) : cfg(cfg), rng(cfg.seed), zipf(cfg.theta) {}
+
+      op next_insert() {
+        bool fresh = values.size() == 0 || std::uniform_real_distribution<double>(0, 1)(rng) >= cfg.dup;
+        size_t k = fresh ? new_key() : pick();
+        return {INSERT, k, values[k]++};
+      }
+
+      /// the number of keys handed out so far
+      size_t keys() const {
+        return values.size();
+      }
+
+      /// an inserted key, drawn from the configured distribution
+      size_t next_read() {
+        return values.size() == 0 ? 0 : pick();
+      }
+
+      op next() {
+        size_t total = cfg.read + cfg.insert + cfg.remove;
+        size_t r = total == 0 ? 0 : rng() % total;
+        if (values.size() == 0 || (r >= cfg.read && r < cfg.read + cfg.insert)) return next_insert();
+        size_t k = pick();
+        if (r < cfg.read) return {READ, k, 0};
+        return {REMOVE, k, values[k] == 0 ? 0 : int(rng() % values[k])};
+      }
+
+      /// key i as a string of cfg.keylen characters
+      template<int length>
+      m_string<length> key(size_t i) const {
+        std::string s = "k" + std::to_string(i);
+        size_t len = std::min<size_t>(std::max(cfg.keylen, s.size()), length - 1);
+        s.resize(len, 'x');
+        return m_string<length>(s.c_str());
+      }
+    };
+
+    /// @Latency
+    /// per-operation latencies in nanoseconds
+    class Latency {
+      vector<uint64_t> ns;
+      bool sorted = false;
+
+    public:
+      void add(uint64_t t) {
+        ns.push_back(t);
+        sorted = false;
+      }
+
+      size_t count() const {
+        return ns.size();
+      }
+
+      /// the q-quantile, q in [0, 1]
+      uint64_t percentile(double q) {
+        if (ns.size() == 0) return 0;
+        if (!sorted) {
+          std::sort(&ns[0], &ns[0] + ns.size());
+          sorted = true;
+        }
+        auto i = size_t(q * double(ns.size() - 1) + 0.5);
+        return ns[i];
+      }
+    };
+
+}
+
+#endif //BPTREE_WORKLOAD_H
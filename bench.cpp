@@ -0,0 +1,808 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <filesystem>
+#include <cstdlib>
+#include <new>
+#include <map>
+#include "BlockRiver.h"
+#include "map.h"
+#include "bmap.h"
+#include "MemTable.h"
+#include "FindCache.h"
+#include "Posting.h"
+#include "Workload.h"
+#include "Shard.h"
+#include "Parallel.h"
+
+typedef arima_kana::m_string<69> mstr;
+
+/// every plain operator new is counted, see alloc_bench
+static std::atomic<size_t> new_calls{0};
+
+void *operator new(size_t n) {
+  new_calls.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(n)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+static constexpr int KEYS = 10000;
+static constexpr int PAIRS = 40000;
+static constexpr int QUERIES = 200000;
+static constexpr int SCANS = 50;
+
+double seconds_since(std::chrono::steady_clock::time_point st) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - st).count();
+}
+
+void remove_files(const std::string &fn) {
+  std::filesystem::remove(fn);
+  std::filesystem::remove(fn + "_index");
+  std::filesystem::remove(fn + "_ptt");
+  std::filesystem::remove(fn + "_bloom");
+  std::filesystem::remove(fn + "_hash");
+  std::filesystem::remove(fn + "_hdir");
+  std::filesystem::remove(fn + "_post");
+}
+
+size_t file_size(const std::string &fn) {
+  return std::filesystem::exists(fn) ? std::filesystem::file_size(fn) : 0;
+}
+
+mstr make_key(int i) {
+  std::string s = "key_" + std::to_string(i);
+  return mstr(s.c_str());
+}
+
+/// @bench_config
+/// the load most benches start from: `pairs` uniform inserts
+/// spread over about `keys` keys (see Workload)
+arima_kana::Workload_Config bench_config(size_t keys, size_t pairs) {
+  arima_kana::Workload_Config cfg;
+  cfg.dist = "uniform";
+  cfg.preload = pairs;
+  cfg.dup = 1 - (double) keys / pairs;
+  return cfg;
+}
+
+/// @generate
+/// draws n inserts from w and hands each to fn(key, value);
+/// returns the seconds taken
+template<class F>
+double generate(arima_kana::Workload &w, size_t n, F &&fn) {
+  auto st = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; ++i) {
+    arima_kana::Workload::op o = w.next_insert();
+    fn(w.key<69>(o.key), o.value);
+  }
+  return seconds_since(st);
+}
+
+/// @load inserts n pairs drawn from w into store
+template<class Store>
+double load(Store &store, arima_kana::Workload &w, size_t n) {
+  return generate(w, n, [&store](const mstr &k, int v) { store.insert(k, v); });
+}
+
+/// @layout_bench
+/// lookup and key-only scan throughput of a BlockRiver
+/// with the given page layout
+template<class Layout>
+void layout_bench(const std::string &name) {
+  std::string fn = "bench_" + name;
+  remove_files(fn);
+  {
+    arima_kana::BlockRiver<mstr, int, 4096, Layout> river(fn);
+    auto cfg = bench_config(KEYS, PAIRS);
+    arima_kana::Workload w(cfg);
+    load(river, w, PAIRS);
+
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+      found += res.size();
+    }
+    double t_find = seconds_since(st);
+
+    mstr probe = w.key<69>(w.keys() / 2);
+    size_t below = 0;
+    st = std::chrono::steady_clock::now();
+    for (int s = 0; s < SCANS; ++s) {
+      for (size_t b = 1; b <= river.block_num; ++b) {
+        auto &node = river.data_list.get(b);
+        for (size_t j = 0; j < node.size; ++j) {
+          if (node._data.key(j) < probe) ++below;
+        }
+      }
+    }
+    double t_scan = seconds_since(st);
+
+    std::cout << name << ": find " << QUERIES / t_find << " ops/s (" << found << " values), "
+              << "scan " << SCANS * (double) PAIRS / t_scan << " pairs/s (" << below << ")\n";
+  }
+  remove_files(fn);
+}
+
+/// @compress_bench
+/// on-disk footprint and find throughput of a data file
+/// much larger than the data buffer, raw or compressed
+template<bool compress>
+void compress_bench(const std::string &name) {
+  typedef arima_kana::BlockRiver<mstr, int, 4096, arima_kana::aos_layout, compress> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000, LARGE_QUERIES = 20000;
+  std::string fn = "bench_" + name;
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  auto st = std::chrono::steady_clock::now();
+  {
+    river_t river(fn);
+    load(river, w, LARGE_PAIRS);
+  }
+  double t_build = seconds_since(st);
+  size_t bytes = file_size(fn) + file_size(fn + "_ptt");
+  {
+    river_t river(fn);
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+      found += res.size();
+    }
+    double t_find = seconds_since(st);
+    std::cout << name << ": data file " << bytes / 1024 << " KiB, build " << t_build << " s, "
+              << "find " << LARGE_QUERIES / t_find << " ops/s (" << found << " values)\n";
+  }
+  remove_files(fn);
+}
+
+/// @bloom_bench
+/// find throughput on absent keys with per-block Bloom filters
+/// of the given size; every check that is not skipped is a false positive
+template<size_t bits>
+void bloom_bench() {
+  typedef arima_kana::BlockRiver<mstr, int, 4096, arima_kana::aos_layout, false, bits> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000, LARGE_QUERIES = 20000;
+  std::string fn = "bench_bloom";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    river_t river(fn);
+    load(river, w, LARGE_PAIRS);
+  }
+  {
+    river_t river(fn);
+    arima_kana::vector<int> res;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.keys() + w.next_read()), res);// never inserted
+    }
+    double t_find = seconds_since(st);
+    std::cout << "bloom " << bits << " bits/block: absent find " << LARGE_QUERIES / t_find << " ops/s, "
+              << "false positives " << river.bloom.checks - river.bloom.skips << '/' << river.bloom.checks << '\n';
+  }
+  remove_files(fn);
+}
+
+/// @hash_index_bench
+/// exact find throughput on a reopened data file much larger
+/// than the data buffer, through the tree or the hash index
+template<bool hash_index>
+void hash_index_bench() {
+  typedef arima_kana::BlockRiver<mstr, int, 4096, arima_kana::aos_layout, false, 0, hash_index> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000, LARGE_QUERIES = 20000;
+  std::string fn = "bench_hash_index";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    river_t river(fn);
+    load(river, w, LARGE_PAIRS);
+  }
+  {
+    river_t river(fn);
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+      found += res.size();
+    }
+    double t_find = seconds_since(st);
+    std::cout << (hash_index ? "hash index" : "tree") << ": exact find " << LARGE_QUERIES / t_find
+              << " ops/s (" << found << " values)";
+    if constexpr (hash_index) std::cout << ", " << (double) river.index.probes / LARGE_QUERIES << " buckets/query";
+    std::cout << '\n';
+  }
+  remove_files(fn);
+}
+
+/// @posting_bench
+/// footprint and find throughput of a few keys with many values each,
+/// one pair per value (BlockRiver) or one posting list per key (Posting_River)
+template<class River>
+void posting_bench(const std::string &name) {
+  static constexpr int HOT_KEYS = 40, LARGE_PAIRS = 400000, LARGE_QUERIES = 2000;
+  std::string fn = "bench_" + name;
+  remove_files(fn);
+  auto cfg = bench_config(HOT_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  auto st = std::chrono::steady_clock::now();
+  {
+    River river(fn);
+    load(river, w, LARGE_PAIRS);
+  }
+  double t_build = seconds_since(st);
+  size_t bytes = file_size(fn) + file_size(fn + "_index") + file_size(fn + "_post");
+  {
+    River river(fn);
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+      found += res.size();
+    }
+    double t_find = seconds_since(st);
+    std::cout << name << ": " << bytes / 1024 << " KiB on disk, build " << t_build << " s, find "
+              << LARGE_QUERIES / t_find << " ops/s (" << found << " values)\n";
+  }
+  remove_files(fn);
+}
+
+/// @memtable_bench
+/// build throughput of random inserts and removes,
+/// applied directly or through a Mem_Table of the given capacity
+template<size_t capacity>
+void memtable_bench() {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000;
+  std::string fn = "bench_memtable";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  cfg.read = 0, cfg.insert = 80, cfg.remove = 20;
+  arima_kana::Workload w(cfg);
+  auto st = std::chrono::steady_clock::now();
+  size_t flushes = 0;
+  {
+    std::conditional_t<capacity == 0, river_t, arima_kana::Mem_Table<river_t, capacity>> river(fn);
+    for (int i = 0; i < LARGE_PAIRS; ++i) {
+      arima_kana::Workload::op o = w.next();
+      mstr k = w.key<69>(o.key);
+      if (o.type == arima_kana::Workload::REMOVE) river.remove(k, o.value);
+      else river.insert(k, o.value);
+    }
+    if constexpr (capacity != 0) flushes = river.flushes;
+  }
+  double t_build = seconds_since(st);
+  std::cout << "memtable " << capacity << ": build " << LARGE_PAIRS / t_build << " ops/s ("
+            << flushes << " flushes)\n";
+  remove_files(fn);
+}
+
+/// @cache_bench
+/// find throughput under skewed traffic, 90% of the queries
+/// going to 1000 hot keys, with and without a Find_Cache
+template<bool cached>
+void cache_bench() {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000, LARGE_QUERIES = 200000, HOT = 1000;
+  std::string fn = "bench_cache";
+  remove_files(fn);
+  std::mt19937 rng(2024);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    std::conditional_t<cached, arima_kana::Find_Cache<river_t>, river_t> river(fn);
+    load(river, w, LARGE_PAIRS);
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      size_t k = rng() % 10 != 0 ? rng() % HOT : w.next_read();
+      river.find(w.key<69>(k), res);
+      found += res.size();
+    }
+    double t_find = seconds_since(st);
+    std::cout << (cached ? "cached" : "uncached") << ": skewed find " << LARGE_QUERIES / t_find
+              << " ops/s (" << found << " values)";
+    if constexpr (cached) std::cout << ", hit rate " << river.hit_rate();
+    std::cout << '\n';
+  }
+  remove_files(fn);
+}
+
+/// the m_string hash before hash_bytes, for comparison
+unsigned long long poly_hash(const mstr &key) {
+  unsigned long long h = 0;
+  for (int i = 0; i < 69; i++) h = h * 1471 + key.id[i];
+  return h;
+}
+
+/// @hash_bench
+/// throughput of a key hash and how evenly it spreads
+/// LARGE_KEYS keys over as many buckets, compared with a random function
+template<class H>
+void hash_bench(const std::string &name, H &&h) {
+  static constexpr int LARGE_KEYS = 65536, ROUNDS = 100;
+  arima_kana::vector<mstr> keys;
+  for (int i = 0; i < LARGE_KEYS; ++i) keys.push_back(make_key(i));
+  unsigned long long sum = 0;
+  auto st = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (int i = 0; i < LARGE_KEYS; ++i) sum += h(keys[i]);
+  }
+  double t_hash = seconds_since(st);
+  arima_kana::vector<int> load;
+  load.resize(LARGE_KEYS);
+  size_t used = 0;
+  int longest = 0;
+  for (int i = 0; i < LARGE_KEYS; ++i) {
+    int &l = load[h(keys[i]) % LARGE_KEYS];
+    if (l++ == 0) ++used;
+    if (l > longest) longest = l;
+  }
+  std::cout << name << " hash: " << (double) ROUNDS * LARGE_KEYS / t_hash << " keys/s (" << sum % 10 << "), "
+            << used << '/' << LARGE_KEYS << " buckets used (random: " << (int) (LARGE_KEYS * (1 - std::exp(-1.0)))
+            << "), longest chain " << longest << '\n';
+}
+
+/// @descent_bench
+/// index descents per insert, remove and find;
+/// the keys are inserted in ascending order, so most inserts raise the maximum
+void descent_bench() {
+  std::string fn = "bench_descent";
+  remove_files(fn);
+  {
+    arima_kana::BlockRiver<mstr, int> river(fn);
+    std::mt19937 rng(2024);
+    size_t d = river.list.descents;
+    for (int i = 0; i < PAIRS; ++i) {
+      int v = i % 7;
+      river.insert(make_key(1000000 + i / 7), v);
+    }
+    double d_insert = (double) (river.list.descents - d) / PAIRS;
+    d = river.list.descents;
+    for (int i = 0; i < PAIRS; ++i) {
+      int v = (int) (rng() % 7);
+      river.remove(make_key(1000000 + (int) (rng() % (PAIRS / 7))), v);
+    }
+    double d_remove = (double) (river.list.descents - d) / PAIRS;
+    arima_kana::vector<int> res;
+    d = river.list.descents;
+    for (int i = 0; i < QUERIES; ++i) {
+      res.clear();
+      river.find(make_key(1000000 + (int) (rng() % (PAIRS / 7))), res);
+    }
+    double d_find = (double) (river.list.descents - d) / QUERIES;
+    std::cout << "descents per op: insert " << d_insert << ", remove " << d_remove << ", find " << d_find << '\n';
+  }
+  remove_files(fn);
+}
+
+/// @alloc_bench
+/// heap allocations per find on a dataset that fits in the buffers,
+/// both through arima_kana::allocator and operator new
+void alloc_bench() {
+  std::string fn = "bench_alloc";
+  remove_files(fn);
+  {
+    arima_kana::BlockRiver<mstr, int> river(fn);
+    auto cfg = bench_config(KEYS, PAIRS);
+    arima_kana::Workload w(cfg);
+    load(river, w, PAIRS);
+    arima_kana::vector<int> res;
+    arima_kana::vector<mstr> keys;
+    for (int i = 0; i < QUERIES; ++i) keys.push_back(w.key<69>(w.next_read()));
+    size_t vec_allocs = arima_kana::alloc_stats::allocations, news = new_calls;
+    for (int i = 0; i < QUERIES; ++i) {
+      res.clear();
+      river.find(keys[i], res);
+    }
+    vec_allocs = arima_kana::alloc_stats::allocations - vec_allocs;
+    news = new_calls - news;
+    std::cout << "find allocations: " << (double) vec_allocs / QUERIES << " vector, "
+              << (double) news / QUERIES << " operator new per query\n";
+  }
+  remove_files(fn);
+}
+
+/// @map_bench
+/// insert, find and erase throughput of an in-memory ordered map
+/// over n random int keys
+template<class M>
+void map_bench(const std::string &name, int n) {
+  typedef typename M::value_type value_type;
+  std::mt19937 rng(2024);
+  arima_kana::vector<int> keys;
+  for (int i = 0; i < n; ++i) keys.push_back((int) rng());
+  M m;
+  auto st = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i) m.insert(value_type(keys[i], i));
+  double t_insert = seconds_since(st);
+  size_t found = 0;
+  st = std::chrono::steady_clock::now();
+  for (int i = 0; i < QUERIES; ++i) {
+    if (m.find(keys[rng() % n]) != m.end()) ++found;
+  }
+  double t_find = seconds_since(st);
+  st = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i += 2) {
+    auto it = m.find(keys[i]);
+    if (it != m.end()) m.erase(it);
+  }
+  double t_erase = seconds_since(st);
+  std::cout << name << " n=" << n << ": insert " << n / t_insert << " ops/s, find "
+            << QUERIES / t_find << " ops/s (" << found << "), erase " << (n + 1) / 2 / t_erase << " ops/s\n";
+}
+
+/// page reads and writes of one buffer
+struct page_io {
+  size_t reads, writes;
+};
+
+template<class B>
+page_io io_of(const B &buffer) {
+  return {buffer.reads, buffer.writes};
+}
+
+/// @drive_workload
+/// preloads store with cfg.preload inserts and runs cfg.ops operations of the mix;
+/// apply(op, key) executes one operation,
+/// io() returns the page I/O of the index and data buffers
+template<class Apply, class IO>
+void drive_workload(const arima_kana::Workload_Config &cfg, Apply &&apply, IO &&io) {
+  typedef arima_kana::Workload workload;
+  workload w(cfg);
+  auto st = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < cfg.preload; ++i) {
+    workload::op o = w.next_insert();
+    apply(o, w.key<69>(o.key));
+  }
+  double t_preload = seconds_since(st);
+  auto io_st = io();
+  arima_kana::Latency lat[3];
+  const char *names[3] = {"read", "insert", "remove"};
+  st = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < cfg.ops; ++i) {
+    workload::op o = w.next();
+    mstr k = w.key<69>(o.key);
+    auto op_st = std::chrono::steady_clock::now();
+    apply(o, k);
+    lat[o.type].add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - op_st).count());
+  }
+  double t_run = seconds_since(st);
+  auto io_end = io();
+  std::cout << "workload: target=" << cfg.target << " dist=" << cfg.dist;
+  if (cfg.dist == "zipf") std::cout << '(' << cfg.theta << ')';
+  std::cout << " keylen=" << cfg.keylen << " mix=" << cfg.read << '/' << cfg.insert << '/' << cfg.remove
+            << " dup=" << cfg.dup << '\n'
+            << "preload: " << cfg.preload << " inserts, " << cfg.preload / t_preload << " ops/s\n"
+            << "run: " << cfg.ops << " ops, " << cfg.ops / t_run << " ops/s\n";
+  for (int t = 0; t < 3; ++t) {
+    if (lat[t].count() == 0) continue;
+    std::cout << "  " << names[t] << " x" << lat[t].count() << " latency us: p50 " << lat[t].percentile(0.5) / 1e3
+              << ", p90 " << lat[t].percentile(0.9) / 1e3 << ", p99 " << lat[t].percentile(0.99) / 1e3
+              << ", p99.9 " << lat[t].percentile(0.999) / 1e3 << ", max " << lat[t].percentile(1) / 1e3 << '\n';
+  }
+  std::cout << "page I/O per op: index " << (double) (io_end.first.reads - io_st.first.reads) / cfg.ops << " reads, "
+            << (double) (io_end.first.writes - io_st.first.writes) / cfg.ops << " writes; data "
+            << (double) (io_end.second.reads - io_st.second.reads) / cfg.ops << " reads, "
+            << (double) (io_end.second.writes - io_st.second.writes) / cfg.ops << " writes\n";
+}
+
+/// @workload_bench runs the workload described by the arguments
+void workload_bench(const arima_kana::Workload_Config &cfg) {
+  typedef arima_kana::Workload workload;
+  remove_files(cfg.fn);
+  if (cfg.target == "river") {
+    arima_kana::BlockRiver<mstr, int> river(cfg.fn);
+    arima_kana::vector<int> res;
+    drive_workload(cfg, [&](const workload::op &o, const mstr &k) {
+      int v = o.value;
+      if (o.type == workload::INSERT) river.insert(k, v);
+      else if (o.type == workload::REMOVE) river.remove(k, v);
+      else {
+        res.clear();
+        river.find(k, res);
+      }
+    }, [&] { return std::make_pair(io_of(river.list.list), io_of(river.data_list)); });
+  } else if (cfg.target == "tree") {
+    typedef arima_kana::page_sizing<mstr, int, 4096> sizing;
+    arima_kana::BPTree<mstr, int, sizing::degree, sizing::min_size, arima_kana::aos_layout, 4096> tree(cfg.fn);
+    size_t blocks = 0;
+    drive_workload(cfg, [&](const workload::op &o, const mstr &k) {
+      if (o.type == workload::INSERT) tree.insert(k, o.value, ++blocks);
+      else if (o.type == workload::REMOVE) tree.remove(k, o.value);
+      else tree.for_each_block(k, [](size_t) {});
+    }, [&] { return std::make_pair(io_of(tree.list), page_io{0, 0}); });
+  } else {
+    arima_kana::Workload_Config::usage();
+  }
+  std::cout << "disk: " << (file_size(cfg.fn) + file_size(cfg.fn + "_index")) / 1024 << " KiB\n";
+  remove_files(cfg.fn);
+}
+
+/// @shard_bench
+/// insert and batched find throughput of a BlockRiver
+/// split over the given number of worker-owned shards
+void shard_bench(size_t shards) {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000, LARGE_QUERIES = 200000, BATCH = 256;
+  std::string fn = "bench_shard";
+  std::filesystem::remove(fn + "_shards");
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    arima_kana::Sharded_River<river_t> river(fn, shards);
+    auto st = std::chrono::steady_clock::now();
+    load(river, w, LARGE_PAIRS);
+    river.sync();
+    double t_build = seconds_since(st);
+    mstr keys[BATCH];
+    arima_kana::vector<int> res[BATCH];
+    size_t found = 0;
+    st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; i += BATCH) {
+      for (int j = 0; j < BATCH; ++j) {
+        keys[j] = w.key<69>(w.next_read());
+        res[j].clear();
+      }
+      river.find_batch(keys, BATCH, res);
+      for (int j = 0; j < BATCH; ++j) found += res[j].size();
+    }
+    double t_find = seconds_since(st);
+    std::cout << "shards " << shards << ": insert " << LARGE_PAIRS / t_build << " ops/s, batched find "
+              << LARGE_QUERIES / t_find << " ops/s (" << found << " values)\n";
+  }
+  for (size_t i = 0; i < shards; ++i) remove_files(fn + "_shard" + std::to_string(i));
+  std::filesystem::remove(fn + "_shards");
+}
+
+/// @bulk_bench
+/// building a BlockRiver by one insert per pair
+/// against bulk_build with the given threads, then a verify_river scan
+void bulk_bench() {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 50000, LARGE_PAIRS = 400000;
+  std::string fn = "bench_bulk";
+  arima_kana::vector<river_t::KV> pairs;
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  generate(w, LARGE_PAIRS, [&](const mstr &k, int v) { pairs.push_back(river_t::KV(k, v)); });
+  remove_files(fn);
+  {
+    river_t river(fn);
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_PAIRS; ++i) river.insert(pairs[i].first, pairs[i].second);
+    std::cout << "bulk: inserts " << LARGE_PAIRS / seconds_since(st) << " pairs/s\n";
+  }
+  for (size_t threads: {1, 4}) {
+    remove_files(fn);
+    arima_kana::vector<river_t::KV> copy;
+    for (int i = 0; i < LARGE_PAIRS; ++i) copy.push_back(pairs[i]);
+    river_t river(fn);
+    auto st = std::chrono::steady_clock::now();
+    arima_kana::bulk_build(river, copy, threads);
+    double t_build = seconds_since(st);
+    st = std::chrono::steady_clock::now();
+    auto stats = arima_kana::verify_river(river, threads);
+    double t_scan = seconds_since(st);
+    std::cout << "bulk: " << threads << " threads build " << LARGE_PAIRS / t_build << " pairs/s, scan "
+              << stats.pairs / t_scan << " pairs/s (" << stats.blocks << " blocks, "
+              << (stats.ordered ? "ordered" : "NOT ordered") << ")\n";
+  }
+  remove_files(fn);
+}
+
+/// @batch_find_bench
+/// finds on a freshly opened river far larger than its cache,
+/// one by one and through find_batch with each I/O engine
+void batch_find_bench() {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 100000, LARGE_PAIRS = 600000, LARGE_QUERIES = 20000;
+  std::string fn = "bench_batch";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    river_t river(fn);
+    load(river, w, LARGE_PAIRS);
+  }
+  arima_kana::vector<mstr> keys;
+  for (int i = 0; i < LARGE_QUERIES; ++i) keys.push_back(w.key<69>(w.next_read()));
+  static arima_kana::vector<int> res[LARGE_QUERIES];
+  for (int mode = 0; mode < 3; ++mode) {
+    river_t river(fn);
+    if (mode == 2) river.io.reset(new arima_kana::Async_Reader(64, 4, false));
+    for (int i = 0; i < LARGE_QUERIES; ++i) res[i].clear();
+    auto st = std::chrono::steady_clock::now();
+    if (mode == 0) {
+      for (int i = 0; i < LARGE_QUERIES; ++i) river.find(keys[i], res[i]);
+    } else {
+      river.find_batch(&keys[0], LARGE_QUERIES, res);
+    }
+    double t = seconds_since(st);
+    const char *name = mode == 0 ? "serial" : mode == 1 ? (river.io->uring() ? "io_uring" : "pool") : "pool";
+    std::cout << "batch find (" << name << "): " << LARGE_QUERIES / t << " ops/s, "
+              << river.data_list.reads << " block reads\n";
+  }
+  remove_files(fn);
+}
+
+/// @prefetch_bench
+/// finds of keys spanning many blocks on a freshly opened,
+/// bulk-built river, with the given read-ahead depth
+void prefetch_bench(size_t depth) {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 500, LARGE_PAIRS = 600000, LARGE_QUERIES = 2000;
+  std::string fn = "bench_prefetch";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    arima_kana::vector<river_t::KV> pairs;
+    generate(w, LARGE_PAIRS, [&](const mstr &k, int v) { pairs.push_back(river_t::KV(k, v)); });
+    river_t river(fn);
+    arima_kana::bulk_build(river, pairs);
+  }
+  {
+    river_t river(fn);
+    river.data_list.prefetch_depth = depth;
+    arima_kana::vector<int> res;
+    size_t found = 0;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+      found += res.size();
+    }
+    double t = seconds_since(st);
+    std::cout << "prefetch " << depth << ": find " << LARGE_QUERIES / t << " ops/s (" << found << " values), "
+              << river.data_list.prefetched << " read ahead, " << river.data_list.prefetch_hits << " used\n";
+  }
+  remove_files(fn);
+}
+
+/// @direct_bench
+/// build and find throughput of a BlockRiver
+/// with buffered or O_DIRECT file I/O
+void direct_bench(bool direct) {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 100000, LARGE_PAIRS = 400000, LARGE_QUERIES = 100000;
+  std::string fn = "bench_direct";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  {
+    river_t river(fn);
+    bool on = direct && river.use_direct();
+    double t_build = load(river, w, LARGE_PAIRS);
+    arima_kana::vector<int> res;
+    auto st = std::chrono::steady_clock::now();
+    for (int i = 0; i < LARGE_QUERIES; ++i) {
+      res.clear();
+      river.find(w.key<69>(w.next_read()), res);
+    }
+    double t_find = seconds_since(st);
+    std::cout << (on ? "O_DIRECT" : "buffered") << ": build " << LARGE_PAIRS / t_build << " ops/s, find "
+              << LARGE_QUERIES / t_find << " ops/s\n";
+  }
+  remove_files(fn);
+}
+
+/// @shutdown_bench
+/// time to checkpoint a BlockRiver full of cached blocks inserted in random order,
+/// writing at most max_run adjacent pages per call, then to checkpoint again
+/// and close after a read-only phase, which leaves every page clean
+void shutdown_bench(size_t max_run) {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int LARGE_KEYS = 100000, LARGE_PAIRS = 400000, LARGE_QUERIES = 100000;
+  std::string fn = "bench_shutdown";
+  remove_files(fn);
+  auto cfg = bench_config(LARGE_KEYS, LARGE_PAIRS);
+  arima_kana::Workload w(cfg);
+  auto river = std::make_unique<river_t>(fn);
+  river->list.list.max_run = river->data_list.max_run = max_run;
+  load(*river, w, LARGE_PAIRS);
+  auto pages = [&river] { return river->list.list.writes + river->data_list.writes; };
+  size_t before = pages();
+  auto st = std::chrono::steady_clock::now();
+  river->checkpoint();
+  double t_checkpoint = seconds_since(st);
+  size_t runs = river->list.list.write_runs + river->data_list.write_runs, dirty = pages() - before;
+  arima_kana::vector<int> res;
+  for (int i = 0; i < LARGE_QUERIES; ++i) {
+    res.clear();
+    river->find(w.key<69>(w.next_read()), res);
+  }
+  before = pages();
+  st = std::chrono::steady_clock::now();
+  river->checkpoint();
+  double t_clean = seconds_since(st);
+  size_t clean = pages() - before;
+  st = std::chrono::steady_clock::now();
+  river.reset();
+  double t_close = seconds_since(st);
+  std::cout << "shutdown, runs of " << max_run << ": checkpoint " << t_checkpoint * 1000 << " ms (" << dirty
+            << " pages in " << runs << " writes), after reads " << t_clean * 1000 << " ms (" << clean
+            << " pages), close " << t_close * 1000 << " ms\n";
+  remove_files(fn);
+}
+
+/// without arguments the fixed suite runs,
+/// otherwise the arguments describe one workload (see Workload_Config)
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    arima_kana::Workload_Config cfg;
+    try {
+      for (int i = 1; i < argc; ++i) cfg.set(argv[i]);
+    } catch (ErrorException &e) {
+      std::cout << e.getMessage() << '\n';
+      arima_kana::Workload_Config::usage();
+      return 1;
+    }
+    workload_bench(cfg);
+    return 0;
+  }
+  for (int n: {1000, 100000, 1000000}) {
+    map_bench<std::map<int, int>>("std::map", n);
+    map_bench<arima_kana::map<int, int>>("aa map", n);
+    map_bench<arima_kana::bmap<int, int>>("bmap", n);
+  }
+  hash_bench("poly", poly_hash);
+  hash_bench("wyhash", [](const mstr &k) { return arima_kana::hash(k); });
+  alloc_bench();
+  descent_bench();
+  layout_bench<arima_kana::aos_layout>("aos");
+  layout_bench<arima_kana::soa_layout>("soa");
+  compress_bench<false>("raw");
+  compress_bench<true>("compressed");
+  bloom_bench<0>();
+  bloom_bench<256>();
+  bloom_bench<512>();
+  bloom_bench<1024>();
+  hash_index_bench<false>();
+  hash_index_bench<true>();
+  posting_bench<arima_kana::BlockRiver<mstr, int>>("pairs");
+  posting_bench<arima_kana::Posting_River<mstr, int>>("postings");
+  memtable_bench<0>();
+  memtable_bench<4096>();
+  memtable_bench<65536>();
+  cache_bench<false>();
+  cache_bench<true>();
+  shard_bench(1);
+  shard_bench(4);
+  bulk_bench();
+  batch_find_bench();
+  prefetch_bench(0);
+  prefetch_bench(8);
+  prefetch_bench(32);
+  direct_bench(false);
+  direct_bench(true);
+  shutdown_bench(1);
+  shutdown_bench(IOV_MAX);
+  return 0;
+}
@@ -0,0 +1,533 @@
+#ifndef BPTREE_BMAP_H
+#define BPTREE_BMAP_H
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include <type_traits>
+#include "utility.h"
+#include "error.h"
+
+namespace arima_kana {
+
+    /// @bmap
+    /// an in-memory B+ tree with the interface of arima_kana::map.
+    /// Leaves keep up to `fanout` values in a sorted array and are linked
+    /// into a list, so lookups touch a few cache lines per level
+    /// instead of one pointer per comparison.
+    /// Unlike map, insert and erase invalidate iterators.
+    template<class Key, class T, class Compare = std::less<Key>, size_t fanout = 32>
+    class bmap {
+      static_assert(fanout >= 4, "fanout too small");
+
+    public:
+      typedef arima_kana::pair<Key, T> value_type;
+      typedef Key key_type;
+      typedef T mapped_type;
+
+    private:
+      static constexpr size_t LEAF_MIN = fanout / 2;
+      static constexpr size_t INNER_MIN = fanout / 2;
+
+      struct Leaf {
+        size_t n = 0;
+        Leaf *prev = nullptr, *next = nullptr;
+        value_type val[fanout];
+      };
+
+      /// n children, key[i] separates chil[i] and chil[i + 1]:
+      /// every key in chil[i + 1] is no less than key[i]
+      struct Inner {
+        size_t n = 0;
+        Key key[fanout];
+        void *chil[fanout];
+      };
+
+      void *root;
+      size_t height;// 0 means the root is a leaf
+      size_t _size;
+      Leaf *head, *tail;
+      Pool<Leaf> leaves;
+      Pool<Inner> inners;
+
+      struct split_info {
+        void *right;
+        Key sep;
+      };
+
+      static bool less(const Key &a, const Key &b) {
+        return Compare()(a, b);
+      }
+
+      static size_t leaf_lower_bound(const Leaf *leaf, const Key &key) {
+        size_t l = 0, r = leaf->n;
+        while (l < r) {
+          size_t mid = (l + r) / 2;
+          if (less(leaf->val[mid].first, key)) l = mid + 1;
+          else r = mid;
+        }
+        return l;
+      }
+
+      /// the child of an inner node that may hold key
+      static size_t child_index(const Inner *node, const Key &key) {
+        size_t l = 0, r = node->n - 1;
+        while (l < r) {
+          size_t mid = (l + r) / 2;
+          if (less(key, node->key[mid])) r = mid;
+          else l = mid + 1;
+        }
+        return l;
+      }
+
+      Leaf *find_leaf(const Key &key) const {
+        if (root == nullptr) return nullptr;
+        void *cur = root;
+        for (size_t h = height; h > 0; --h) {
+          auto node = static_cast<Inner *>(cur);
+          cur = node->chil[child_index(node, key)];
+        }
+        return static_cast<Leaf *>(cur);
+      }
+
+      Leaf *new_leaf_after(Leaf *leaf) {
+        Leaf *right = leaves.create();
+        right->prev = leaf;
+        right->next = leaf->next;
+        if (leaf->next != nullptr) leaf->next->prev = right;
+        else tail = right;
+        leaf->next = right;
+        return right;
+      }
+
+      split_info insert_leaf(Leaf *leaf, const Key &key, const T &value,
+                             Leaf *&res, size_t &res_pos, bool &inserted) {
+        size_t pos = leaf_lower_bound(leaf, key);
+        if (pos < leaf->n && !less(key, leaf->val[pos].first)) {
+          res = leaf, res_pos = pos, inserted = false;
+          return {nullptr, Key()};
+        }
+        inserted = true;
+        ++_size;
+        if (leaf->n < fanout) {
+          for (size_t i = leaf->n; i > pos; --i) leaf->val[i] = leaf->val[i - 1];
+          leaf->val[pos] = value_type(key, value);
+          ++leaf->n;
+          res = leaf, res_pos = pos;
+          return {nullptr, Key()};
+        }
+        Leaf *right = new_leaf_after(leaf);
+        size_t mid = fanout / 2;
+        for (size_t i = mid; i < fanout; ++i) right->val[i - mid] = leaf->val[i];
+        right->n = fanout - mid;
+        leaf->n = mid;
+        Leaf *target = pos <= mid ? leaf : right;
+        if (target == right) pos -= mid;
+        for (size_t i = target->n; i > pos; --i) target->val[i] = target->val[i - 1];
+        target->val[pos] = value_type(key, value);
+        ++target->n;
+        res = target, res_pos = pos;
+        return {right, right->val[0].first};
+      }
+
+      split_info insert_rec(void *cur, size_t h, const Key &key, const T &value,
+                            Leaf *&res, size_t &res_pos, bool &inserted) {
+        if (h == 0) return insert_leaf(static_cast<Leaf *>(cur), key, value, res, res_pos, inserted);
+        auto node = static_cast<Inner *>(cur);
+        size_t i = child_index(node, key);
+        split_info s = insert_rec(node->chil[i], h - 1, key, value, res, res_pos, inserted);
+        if (s.right == nullptr) return s;
+        // the new child goes to position i + 1, its separator to key[i]
+        if (node->n < fanout) {
+          for (size_t j = node->n; j > i + 1; --j) node->chil[j] = node->chil[j - 1];
+          for (size_t j = node->n - 1; j > i; --j) node->key[j] = node->key[j - 1];
+          node->chil[i + 1] = s.right;
+          node->key[i] = s.sep;
+          ++node->n;
+          return {nullptr, Key()};
+        }
+        Key keys[fanout];
+        void *chil[fanout + 1];
+        for (size_t j = 0, k = 0; j <= fanout; ++j) chil[j] = j == i + 1 ? s.right : node->chil[k++];
+        for (size_t j = 0, k = 0; j < fanout; ++j) keys[j] = j == i ? s.sep : node->key[k++];
+        size_t left_n = (fanout + 1) / 2;
+        Inner *right = inners.create();
+        node->n = left_n;
+        right->n = fanout + 1 - left_n;
+        for (size_t j = 0; j < left_n; ++j) node->chil[j] = chil[j];
+        for (size_t j = 0; j + 1 < left_n; ++j) node->key[j] = keys[j];
+        for (size_t j = 0; j < right->n; ++j) right->chil[j] = chil[left_n + j];
+        for (size_t j = 0; j + 1 < right->n; ++j) right->key[j] = keys[left_n + j];
+        return {right, keys[left_n - 1]};
+      }
+
+      /// @fix_child
+      /// child i of node has underflowed,
+      /// borrow from or merge with an adjacent sibling
+      void fix_child(Inner *node, size_t i, size_t child_h) {
+        size_t a = i > 0 ? i - 1 : i, b = a + 1;
+        if (child_h == 0) {
+          auto A = static_cast<Leaf *>(node->chil[a]), B = static_cast<Leaf *>(node->chil[b]);
+          if (A->n > LEAF_MIN && b == i) {
+            for (size_t j = B->n; j > 0; --j) B->val[j] = B->val[j - 1];
+            B->val[0] = A->val[--A->n];
+            ++B->n;
+            node->key[a] = B->val[0].first;
+          } else if (B->n > LEAF_MIN && a == i) {
+            A->val[A->n++] = B->val[0];
+            for (size_t j = 1; j < B->n; ++j) B->val[j - 1] = B->val[j];
+            --B->n;
+            node->key[a] = B->val[0].first;
+          } else {
+            for (size_t j = 0; j < B->n; ++j) A->val[A->n + j] = B->val[j];
+            A->n += B->n;
+            A->next = B->next;
+            if (B->next != nullptr) B->next->prev = A;
+            else tail = A;
+            leaves.destroy(B);
+            remove_child(node, b);
+          }
+          return;
+        }
+        auto A = static_cast<Inner *>(node->chil[a]), B = static_cast<Inner *>(node->chil[b]);
+        if (A->n > INNER_MIN && b == i) {
+          for (size_t j = B->n; j > 0; --j) B->chil[j] = B->chil[j - 1];
+          for (size_t j = B->n - 1; j > 0; --j) B->key[j] = B->key[j - 1];
+          B->chil[0] = A->chil[A->n - 1];
+          B->key[0] = node->key[a];
+          node->key[a] = A->key[A->n - 2];
+          --A->n, ++B->n;
+        } else if (B->n > INNER_MIN && a == i) {
+          A->chil[A->n] = B->chil[0];
+          A->key[A->n - 1] = node->key[a];
+          node->key[a] = B->key[0];
+          for (size_t j = 1; j < B->n; ++j) B->chil[j - 1] = B->chil[j];
+          for (size_t j = 1; j + 1 < B->n; ++j) B->key[j - 1] = B->key[j];
+          ++A->n, --B->n;
+        } else {
+          A->key[A->n - 1] = node->key[a];
+          for (size_t j = 0; j < B->n; ++j) A->chil[A->n + j] = B->chil[j];
+          for (size_t j = 0; j + 1 < B->n; ++j) A->key[A->n + j] = B->key[j];
+          A->n += B->n;
+          inners.destroy(B);
+          remove_child(node, b);
+        }
+      }
+
+      /// removes chil[b] and the separator key[b - 1] in front of it
+      static void remove_child(Inner *node, size_t b) {
+        for (size_t j = b + 1; j < node->n; ++j) node->chil[j - 1] = node->chil[j];
+        for (size_t j = b; j + 1 < node->n; ++j) node->key[j - 1] = node->key[j];
+        --node->n;
+      }
+
+      /// returns whether key was erased; underflow of cur is fixed by the caller
+      bool erase_rec(void *cur, size_t h, const Key &key) {
+        if (h == 0) {
+          auto leaf = static_cast<Leaf *>(cur);
+          size_t pos = leaf_lower_bound(leaf, key);
+          if (pos == leaf->n || less(key, leaf->val[pos].first)) return false;
+          for (size_t j = pos + 1; j < leaf->n; ++j) leaf->val[j - 1] = leaf->val[j];
+          --leaf->n;
+          --_size;
+          return true;
+        }
+        auto node = static_cast<Inner *>(cur);
+        size_t i = child_index(node, key);
+        if (!erase_rec(node->chil[i], h - 1, key)) return false;
+        size_t n = h == 1 ? static_cast<Leaf *>(node->chil[i])->n : static_cast<Inner *>(node->chil[i])->n;
+        if (n < (h == 1 ? LEAF_MIN : INNER_MIN)) fix_child(node, i, h - 1);
+        return true;
+      }
+
+      void destroy(void *cur, size_t h) {
+        if (h == 0) {
+          leaves.destroy(static_cast<Leaf *>(cur));
+          return;
+        }
+        auto node = static_cast<Inner *>(cur);
+        for (size_t i = 0; i < node->n; ++i) destroy(node->chil[i], h - 1);
+        inners.destroy(node);
+      }
+
+    public:
+      class const_iterator;
+
+      class iterator {
+      public:
+        bmap *root;
+        Leaf *leaf;
+        size_t idx;
+
+        iterator() : root(nullptr), leaf(nullptr), idx(0) {}
+
+        iterator(bmap *root, Leaf *leaf, size_t idx) : root(root), leaf(leaf), idx(idx) {}
+
+        iterator &operator++() {
+          if (leaf == nullptr) error("invalid_iterator");
+          if (++idx == leaf->n) leaf = leaf->next, idx = 0;
+          return *this;
+        }
+
+        iterator operator++(int) {
+          iterator tmp = *this;
+          ++*this;
+          return tmp;
+        }
+
+        iterator &operator--() {
+          if (root == nullptr || root->_size == 0) error("invalid_iterator");
+          if (leaf == nullptr) {
+            leaf = root->tail, idx = leaf->n - 1;
+          } else if (idx == 0) {
+            if (leaf->prev == nullptr) error("invalid_iterator");
+            leaf = leaf->prev, idx = leaf->n - 1;
+          } else {
+            --idx;
+          }
+          return *this;
+        }
+
+        iterator operator--(int) {
+          iterator tmp = *this;
+          --*this;
+          return tmp;
+        }
+
+        value_type &operator*() const {
+          return leaf->val[idx];
+        }
+
+        value_type *operator->() const noexcept {
+          return &leaf->val[idx];
+        }
+
+        bool operator==(const iterator &rhs) const {
+          return leaf == rhs.leaf && idx == rhs.idx && root == rhs.root;
+        }
+
+        bool operator==(const const_iterator &rhs) const {
+          return leaf == rhs.leaf && idx == rhs.idx && root == rhs.root;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+          return !(*this == rhs);
+        }
+
+        bool operator!=(const const_iterator &rhs) const {
+          return !(*this == rhs);
+        }
+      };
+
+      class const_iterator {
+      public:
+        const bmap *root;
+        Leaf *leaf;
+        size_t idx;
+
+        const_iterator() : root(nullptr), leaf(nullptr), idx(0) {}
+
+        const_iterator(const iterator &other) : root(other.root), leaf(other.leaf), idx(other.idx) {}
+
+        const_iterator(const bmap *root, Leaf *leaf, size_t idx) : root(root), leaf(leaf), idx(idx) {}
+
+        const_iterator &operator++() {
+          if (leaf == nullptr) error("invalid_iterator");
+          if (++idx == leaf->n) leaf = leaf->next, idx = 0;
+          return *this;
+        }
+
+        const_iterator operator++(int) {
+          const_iterator tmp = *this;
+          ++*this;
+          return tmp;
+        }
+
+        const_iterator &operator--() {
+          if (root == nullptr || root->_size == 0) error("invalid_iterator");
+          if (leaf == nullptr) {
+            leaf = root->tail, idx = leaf->n - 1;
+          } else if (idx == 0) {
+            if (leaf->prev == nullptr) error("invalid_iterator");
+            leaf = leaf->prev, idx = leaf->n - 1;
+          } else {
+            --idx;
+          }
+          return *this;
+        }
+
+        const_iterator operator--(int) {
+          const_iterator tmp = *this;
+          --*this;
+          return tmp;
+        }
+
+        const value_type &operator*() const {
+          return leaf->val[idx];
+        }
+
+        const value_type *operator->() const noexcept {
+          return &leaf->val[idx];
+        }
+
+        bool operator==(const iterator &rhs) const {
+          return leaf == rhs.leaf && idx == rhs.idx && root == rhs.root;
+        }
+
+        bool operator==(const const_iterator &rhs) const {
+          return leaf == rhs.leaf && idx == rhs.idx && root == rhs.root;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+          return !(*this == rhs);
+        }
+
+        bool operator!=(const const_iterator &rhs) const {
+          return !(*this == rhs);
+        }
+      };
+
+      bmap() : root(nullptr), height(0), _size(0), head(nullptr), tail(nullptr) {}
+
+      bmap(const bmap &other) : bmap() {
+        for (auto it = other.cbegin(); it != other.cend(); ++it) insert(*it);
+      }
+
+      bmap &operator=(const bmap &other) {
+        if (&other == this) return *this;
+        clear();
+        for (auto it = other.cbegin(); it != other.cend(); ++it) insert(*it);
+        return *this;
+      }
+
+      ~bmap() {
+        clear();
+      }
+
+      T &at(const Key &key) {
+        iterator it = find(key);
+        if (it == end()) error("index_out_of_bound");
+        return it->second;
+      }
+
+      const T &at(const Key &key) const {
+        const_iterator it = find(key);
+        if (it == cend()) error("index_out_of_bound");
+        return it->second;
+      }
+
+      T &operator[](const Key &key) {
+        return insert(value_type(key, T())).first->second;
+      }
+
+      const T &operator[](const Key &key) const {
+        return at(key);
+      }
+
+      iterator begin() {
+        return iterator(this, _size == 0 ? nullptr : head, 0);
+      }
+
+      const_iterator cbegin() const {
+        return const_iterator(this, _size == 0 ? nullptr : head, 0);
+      }
+
+      iterator end() {
+        return iterator(this, nullptr, 0);
+      }
+
+      const_iterator cend() const {
+        return const_iterator(this, nullptr, 0);
+      }
+
+      bool empty() const {
+        return _size == 0;
+      }
+
+      size_t size() const {
+        return _size;
+      }
+
+      /**
+       * clears the contents,
+       * both node arenas are released as a whole
+       */
+      void clear() {
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+          if (root != nullptr) destroy(root, height);
+        }
+        leaves.release();
+        inners.release();
+        root = nullptr;
+        head = tail = nullptr;
+        height = 0;
+        _size = 0;
+      }
+
+      /**
+       * insert an element.
+       * return a pair, the first of the pair is
+       *   the iterator to the new element (or the element that prevented the insertion),
+       *   the second one is true if insert successfully, or false.
+       */
+      pair<iterator, bool> insert(const value_type &value) {
+        if (root == nullptr) {
+          Leaf *leaf = leaves.create();
+          root = head = tail = leaf;
+          height = 0;
+        }
+        Leaf *res = nullptr;
+        size_t pos = 0;
+        bool inserted = false;
+        split_info s = insert_rec(root, height, value.first, value.second, res, pos, inserted);
+        if (s.right != nullptr) {
+          Inner *new_root = inners.create();
+          new_root->n = 2;
+          new_root->chil[0] = root;
+          new_root->chil[1] = s.right;
+          new_root->key[0] = s.sep;
+          root = new_root;
+          ++height;
+        }
+        return pair<iterator, bool>(iterator(this, res, pos), inserted);
+      }
+
+      /**
+       * erase the element at pos.
+       *
+       * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+       */
+      void erase(iterator pos) {
+        if (pos.leaf == nullptr || pos.root != this || pos.idx >= pos.leaf->n)
+          error("invalid_iterator");
+        Key key = pos->first;
+        erase_rec(root, height, key);
+        while (height > 0 && static_cast<Inner *>(root)->n == 1) {
+          auto old = static_cast<Inner *>(root);
+          root = old->chil[0];
+          inners.destroy(old);
+          --height;
+        }
+        if (_size == 0) clear();
+      }
+
+      iterator find(const Key &key) {
+        Leaf *leaf = find_leaf(key);
+        if (leaf == nullptr) return end();
+        size_t pos = leaf_lower_bound(leaf, key);
+        if (pos == leaf->n || less(key, leaf->val[pos].first)) return end();
+        return iterator(this, leaf, pos);
+      }
+
+      const_iterator find(const Key &key) const {
+        Leaf *leaf = find_leaf(key);
+        if (leaf == nullptr) return cend();
+        size_t pos = leaf_lower_bound(leaf, key);
+        if (pos == leaf->n || less(key, leaf->val[pos].first)) return cend();
+        return const_iterator(this, leaf, pos);
+      }
+    };
+
+}
+
+#endif //BPTREE_BMAP_H
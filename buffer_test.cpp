@@ -0,0 +1,209 @@
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <filesystem>
+#include "BlockRiver.h"
+#include "Buffer.h"
+#include "Parallel.h"
+
+/// regression tests of the buffer layer, run by ctest
+
+typedef arima_kana::m_string<69> mstr;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    std::cout << __FILE__ << ':' << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+    ++failures; \
+  } \
+} while (0)
+
+void remove_files(const std::string &fn) {
+  for (const char *suffix: {"", "_index", "_ptt", "_bloom", "_hash", "_hdir", "_post"}) {
+    std::filesystem::remove(fn + suffix);
+  }
+}
+
+struct page {
+  int v = 0;
+  char pad[252] = {0};
+};
+
+/// a dirty page at the LRU tail inside the read-ahead window
+/// is evicted while the run is admitted; the stale copy read
+/// before the eviction must not replace it
+void prefetch_keeps_dirty_pages() {
+  typedef arima_kana::List_Map_Buffer<page, size_t, 1, 4> buffer;
+  std::string fn = "test_prefetch";
+  {
+    std::ofstream f(fn, std::ios::binary);
+    page zero;
+    f.write(reinterpret_cast<char *>(&zero), buffer::offset(1));
+    for (int i = 0; i < 32; ++i) f.write(reinterpret_cast<char *>(&zero), sizeof(page));
+  }
+  {
+    buffer b(fn);
+    b.prefetch_depth = 4;
+    b[3].v = 100;
+    b[10];
+    b[20];
+    b[1];
+    b[2];// sequential: reads 2 .. 5 ahead, evicting 3
+    CHECK(b[3].v == 100);
+  }
+  {
+    buffer b(fn);
+    CHECK(b[3].v == 100);
+  }
+  std::filesystem::remove(fn);
+}
+
+/// random inserts and removals on a reopened bulk-built river
+/// larger than its cache, against a std::set per key;
+/// direct moves both runs to O_DIRECT where the file system allows it
+void river_matches_reference(unsigned seed, bool direct) {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  static constexpr int KEYS = 30000, PAIRS = 200000, OPS = 5000;
+  std::string fn = "test_river";
+  remove_files(fn);
+  std::mt19937 rng(seed);
+  std::map<std::string, std::set<int>> ref;
+  auto key = [](int i) { return "k" + std::to_string(i); };
+  {
+    arima_kana::vector<river_t::KV> pairs;
+    for (int i = 0; i < PAIRS; ++i) {
+      int k = (int) (rng() % KEYS), v = (int) (rng() % 100000);
+      pairs.push_back(river_t::KV(mstr(key(k).c_str()), v));
+      ref[key(k)].insert(v);
+    }
+    river_t river(fn);
+    if (direct) river.use_direct();
+    arima_kana::bulk_build(river, pairs);
+  }
+  {
+    river_t river(fn);
+    if (direct) river.use_direct();
+    for (int i = 0; i < OPS; ++i) {
+      std::string k = key((int) (rng() % KEYS));
+      int v = (int) (rng() % 100000);
+      if (rng() % 2) {
+        river.insert(mstr(k.c_str()), v);
+        ref[k].insert(v);
+      } else {
+        river.remove(mstr(k.c_str()), v);
+        ref[k].erase(v);
+      }
+    }
+    arima_kana::vector<int> res;
+    for (auto &e: ref) {
+      res.clear();
+      river.find(mstr(e.first.c_str()), res);
+      bool same = res.size() == e.second.size();
+      size_t j = 0;
+      for (auto it = e.second.begin(); same && it != e.second.end(); ++it, ++j) same = res[j] == *it;
+      CHECK(same);
+      if (!same) break;
+    }
+  }
+  remove_files(fn);
+}
+
+/// a run without the hash index changes the blocks under the files
+/// a run with it left; reopening with the index must not trust them
+void hash_index_survives_a_run_without_it() {
+  typedef arima_kana::BlockRiver<mstr, int, 4096, arima_kana::aos_layout, false, 0, true> indexed;
+  typedef arima_kana::BlockRiver<mstr, int> plain;
+  std::string fn = "test_hash";
+  remove_files(fn);
+  {
+    indexed river(fn);
+    for (int i = 0; i < 20000; ++i) river.insert(mstr(("a" + std::to_string(i % 3000)).c_str()), i);
+  }
+  {
+    plain river(fn);
+    for (int i = 0; i < 60; ++i) river.insert(mstr(("z" + std::to_string(i % 10)).c_str()), i);
+  }
+  {
+    indexed river(fn);
+    arima_kana::vector<int> res;
+    river.find(mstr("z7"), res);
+    CHECK(res.size() == 6);
+    res.clear();
+    river.find(mstr("a42"), res);
+    CHECK(res.size() == 7);
+  }
+  remove_files(fn);
+}
+
+/// a block cut short on disk must fail find_batch
+/// rather than be cached empty and written back over the real one
+void find_batch_reports_short_reads() {
+  typedef arima_kana::BlockRiver<mstr, int> river_t;
+  std::string fn = "test_batch";
+  remove_files(fn);
+  size_t blocks;
+  {
+    arima_kana::vector<river_t::KV> pairs;
+    for (int i = 0; i < 20000; ++i) pairs.push_back(river_t::KV(mstr(("k" + std::to_string(i)).c_str()), i));
+    river_t river(fn);
+    arima_kana::bulk_build(river, pairs);
+    blocks = river.block_num;
+  }
+  std::filesystem::resize_file(fn, river_t::buffer::offset(blocks) + 100);
+  {
+    river_t river(fn);
+    mstr keys[] = {mstr("k0"), mstr("k9999")};
+    arima_kana::vector<int> out[2];
+    bool raised = false;
+    try {
+      river.find_batch(keys, 2, out);
+    } catch (ErrorException &) {
+      raised = true;
+    }
+    CHECK(raised);
+  }
+  remove_files(fn);
+}
+
+/// a block growing one pair at a time outgrows its extent again and again;
+/// the extents it leaves must be reused, keeping the file
+/// close to the bytes its blocks pack into
+void compressed_extents_are_reused() {
+  typedef arima_kana::BlockRiver<mstr, int, 4096, arima_kana::aos_layout, true> river_t;
+  static constexpr int KEYS = 2000, STEPS = 6000;
+  std::string fn = "test_extents";
+  remove_files(fn);
+  std::mt19937 rng(7);
+  {
+    river_t river(fn);
+    auto key = [](int i) { return mstr(("k" + std::to_string(i)).c_str()); };
+    for (int i = 0; i < KEYS * 4 + STEPS; ++i) {
+      int v = int(rng());
+      river.insert(key(i < KEYS * 4 ? i % KEYS : 0), v);
+      if (i >= KEYS * 4) river.checkpoint();
+    }
+    size_t live = river_t::buffer::offset(1);
+    std::string packed;
+    for (size_t b = 1; b <= river.block_num; ++b) {
+      arima_kana::pack_block(river.data_list.get(b), packed);
+      live += arima_kana::round_up(packed.size(), 64);
+    }
+    CHECK(std::filesystem::file_size(fn) < live * 5 / 4);
+  }
+  remove_files(fn);
+}
+
+int main() {
+  prefetch_keeps_dirty_pages();
+  hash_index_survives_a_run_without_it();
+  find_batch_reports_short_reads();
+  compressed_extents_are_reused();
+  for (unsigned seed = 1; seed <= 5; ++seed) river_matches_reference(seed, false);
+  for (unsigned seed = 6; seed <= 8; ++seed) river_matches_reference(seed, true);
+  if (failures == 0) std::cout << "all passed\n";
+  return failures == 0 ? 0 : 1;
+}
@@ -4,6 +4,8 @@
 #include <fstream>
 #include "BPtree.h"
 #include "BlockRiver.h"
+#include "Frontend.h"
+#include "Shard.h"
 
 using std::cin;
 using std::cout;
@@ -39,59 +41,63 @@ void find_key(const std::set<arima_kana::pair<K, V>> &m, const K &k) {
 
 typedef arima_kana::m_string<69> mstr;
 
-int main() {
-  std::ios::sync_with_stdio(false);
-//  cin.tie(nullptr);
-//  cout.tie(nullptr);
-  arima_kana::BlockRiver<mstr, int, 86> bp("fn");
-//  std::set<arima_kana::pair<mstr, int>> mp;
-  mstr s;
-  int n;
-  cin >> n;
-  std::string op;
-  int val;
-  arima_kana::vector<int> p;
-  while (n--) {
-    cin >> op;
-    if (op == "print") {
-      bp.print();
-      continue;
-    } else if (op == "quit") {
-      break;
-    } else if (op == "clear") {
-      bp.clear();
-//      mp.clear();
-    } else {
-      cin >> s;
-      if (op == "insert") {
-        cin >> val;
-        bp.insert(s, val);
-//        bp.map_print(bp.root);
-//        std::cout << '\n';
-//        mp.insert({s, val});
-//        std_map_print(mp);
-//        std::cout << '\n';
-      } else if (op == "delete") {
-        cin >> val;
-        bp.remove(s, val);
-//        bp.map_print(bp.root);
-//        std::cout << '\n';
-//        mp.erase({s, val});
-//        std_map_print(mp);
-//        std::cout << '\n';
-      } else if (op == "find") {
-//        cin >> val;
-        p.clear();
-        bp.find(s, p);
-        for (int i = 0; i < p.size(); ++i) {
-          std::cout << p[i] << ' ';
-        }
-        std::cout << '\n';
-//        find_key(mp, s);
-      } else {
-        continue;
-      }
+template<class River>
+void run(River &bp, arima_kana::Input &in, arima_kana::Output &out, bool binary_mode, bool pipelined) {
+  if (binary_mode) {
+    arima_kana::Binary_Protocol<mstr, int> proto(in);
+    if (pipelined) arima_kana::serve_pipelined(bp, proto, out);
+    else arima_kana::serve(bp, proto, out);
+  } else {
+    arima_kana::Text_Protocol<mstr, int> proto(in);
+    if (pipelined) arima_kana::serve_pipelined(bp, proto, out);
+    else arima_kana::serve(bp, proto, out);
+  }
+}
+
+/// with no argument, serves the text commands on stdin;
+/// --binary serves Binary_Protocol records instead,
+/// --pipelined parses, executes and answers on three threads,
+/// --direct moves the files to O_DIRECT I/O (of every shard with --shards),
+/// and says so on stderr if it falls back to buffered I/O,
+/// --shards=N spreads the keys over N rivers served by worker threads,
+/// --encode translates text commands into binary records
+int main(int argc, char **argv) {
+  bool binary_mode = false, pipelined = false, encode = false, direct = false;
+  size_t shards = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--binary") binary_mode = true;
+    else if (arg == "--pipelined") pipelined = true;
+    else if (arg == "--encode") encode = true;
+    else if (arg == "--direct") direct = true;
+    else if (arg.rfind("--shards=", 0) == 0) shards = std::stoul(arg.substr(9));
+  }
+  arima_kana::Input in(stdin);
+  arima_kana::Output out(stdout);
+  typedef arima_kana::Text_Protocol<mstr, int> text;
+  typedef arima_kana::Binary_Protocol<mstr, int> binary;
+  if (encode) {
+    text proto(in);
+    text::cmd c;
+    while (proto.read(c)) {
+      if (c.op != text::cmd::SKIP) binary::write(out, c);
     }
+    return 0;
+  }
+  if (shards != 0) {
+    try {
+      arima_kana::Sharded_River<arima_kana::BlockRiver<mstr, int>> bp("fn", shards);
+      if (direct && !bp.use_direct()) std::cerr << "--direct: O_DIRECT unavailable, using buffered I/O\n";
+      run(bp, in, out, binary_mode, pipelined);
+    } catch (ErrorException &e) {
+      std::cerr << e.getMessage() << '\n';
+      return 1;
+    }
+  } else {
+    arima_kana::BlockRiver<mstr, int> bp("fn");
+//  std::set<arima_kana::pair<mstr, int>> mp;
+    if (direct && !bp.use_direct()) std::cerr << "--direct: O_DIRECT unavailable, using buffered I/O\n";
+    run(bp, in, out, binary_mode, pipelined);
   }
   return 0;
-}
\ No newline at end of file
+}
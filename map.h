@@ -23,8 +23,9 @@ namespace arima_kana {
       typedef T mapped_type;
       // RE if const Key
 
+      /// the value lives inline, nodes come from the pool
       struct Node {
-        value_type *_val;
+        value_type _val;
         Node *ls, *rs;
         Node *fa;
         int level;
@@ -32,6 +33,7 @@ namespace arima_kana {
 
       Node *AAtree;
       size_t _size;
+      Pool<Node> pool;
 
       /**
        * see BidirectionalIterator at CppReference for help.
@@ -174,7 +176,7 @@ namespace arima_kana {
          * a operator to check whether two iterators are same (pointing to the same memory).
          */
         value_type &operator*() const {
-          return *(pos->_val);
+          return pos->_val;
         }
 
         bool operator==(const iterator &rhs) const {
@@ -201,7 +203,7 @@ namespace arima_kana {
          * See <http://kelvinh.github.io/blog/2013/11/20/overloading-of-member-access-operator-dash-greater-than-symbol-in-cpp/> for help.
          */
         value_type *operator->() const noexcept {
-          return pos->_val;
+          return &pos->_val;
         }
       };
 
@@ -342,7 +344,7 @@ namespace arima_kana {
          * a operator to check whether two iterators are same (pointing to the same memory).
          */
         value_type &operator*() const {
-          return *(pos->_val);
+          return pos->_val;
         }
 
         bool operator==(const iterator &rhs) const {
@@ -369,7 +371,7 @@ namespace arima_kana {
          * See <http://kelvinh.github.io/blog/2013/11/20/overloading-of-member-access-operator-dash-greater-than-symbol-in-cpp/> for help.
          */
         value_type *operator->() const noexcept {
-          return pos->_val;
+          return &pos->_val;
         }
       };
 
@@ -424,8 +426,7 @@ namespace arima_kana {
 
       Node *copy_ptr(Node *ptr, Node *fa) {
         if (ptr == nullptr) return nullptr;
-        Node *n = new Node{new value_type(*(ptr->_val)), nullptr, nullptr, fa,
-                           ptr->level};
+        Node *n = pool.create(Node{ptr->_val, nullptr, nullptr, fa, ptr->level});
         n->ls = copy_ptr(ptr->ls, n);
         n->rs = copy_ptr(ptr->rs, n);// do not eat a fat man with a mouth
         return n;
@@ -451,13 +452,13 @@ namespace arima_kana {
       T &at(const Key &key) {
         Node *ptr = find_ptr(key);
         if (ptr == nullptr) error("index_out_of_bound");
-        return ptr->_val->second;
+        return ptr->_val.second;
       }
 
       const T &at(const Key &key) const {
         Node *ptr = find_ptr(key);
         if (ptr == nullptr) error("index_out_of_bound");
-        return ptr->_val->second;
+        return ptr->_val.second;
       }
 
       /**
@@ -467,12 +468,8 @@ namespace arima_kana {
        *   performing an insertion if such key does not already exist.
        */
       T &operator[](const Key &key) {
-        Node *ptr = find_ptr(key);
-        if (ptr == nullptr) {
-          insert(AAtree, key, T());
-          ptr = find_ptr(key);
-        }
-        return ptr->_val->second;
+        bool inserted;
+        return insert(AAtree, key, T(), inserted)->_val.second;
       }
 
       /**
@@ -481,7 +478,7 @@ namespace arima_kana {
       const T &operator[](const Key &key) const {
         Node *ptr = find_ptr(key);
         if (ptr == nullptr) error("index_out_of_bound");
-        return ptr->_val->second;
+        return ptr->_val.second;
       }
 
       /**
@@ -533,23 +530,22 @@ namespace arima_kana {
       }
 
       /**
-       * clears the contents
+       * clears the contents,
+       * the node arena is released as a whole
        */
       void clear() {
-        clear(AAtree);
-        delete AAtree;
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+          destroy(AAtree);
+        }
+        pool.release();
         AAtree = nullptr;
         _size = 0;
       }
 
-      void clear(Node *ptr) {
+      void destroy(Node *ptr) {
         if (ptr == nullptr) return;
-        clear(ptr->ls), clear(ptr->rs);
-        delete ptr->ls;
-        delete ptr->_val;
-        delete ptr->rs;
-        ptr->ls = ptr->rs = nullptr;
-        ptr->_val = nullptr;
+        destroy(ptr->ls), destroy(ptr->rs);
+        ptr->_val.~value_type();
       }
 
       /**
@@ -559,38 +555,39 @@ namespace arima_kana {
        *   the second one is true if insert successfully, or false.
        */
       pair<iterator, bool> insert(const value_type &value) {
-//        Node *ptr = find_ptr(value.first);
-//        if (ptr != nullptr) {
-//          return pair<iterator, bool>(iterator(AAtree, ptr), false);
-//        }
-        bool inserted = insert(AAtree, value.first, value.second);
-        return pair<iterator, bool>(find(value.first), inserted);
+        bool inserted;
+        Node *ptr = insert(AAtree, value.first, value.second, inserted);
+        return pair<iterator, bool>(iterator(this, ptr), inserted);
       }
 
-      bool insert(Node *&cur, const Key &key, const T &value) {
-        bool inserted = false;
+      /// returns the new node, or the one holding key already;
+      /// skew and split only relink nodes, so the pointer stays valid
+      Node *insert(Node *&cur, const Key &key, const T &value, bool &inserted) {
+        Node *res;
+        inserted = false;
         if (cur == nullptr) {
-          cur = new Node{new value_type(key, value), nullptr, nullptr, nullptr, 1};
+          cur = pool.create(Node{value_type(key, value), nullptr, nullptr, nullptr, 1});
           ++_size;
           inserted = true;
-        } else if (Compare()(key, cur->_val->first)) {
+          return cur;
+        } else if (Compare()(key, cur->_val.first)) {
           if (cur->ls == nullptr) {
-            cur->ls = new Node{new value_type(key, value), nullptr, nullptr, cur, 1};
+            res = cur->ls = pool.create(Node{value_type(key, value), nullptr, nullptr, cur, 1});
             ++_size;
             inserted = true;
-          } else inserted = insert(cur->ls, key, value);
-        } else if (Compare()(cur->_val->first, key)) {
+          } else res = insert(cur->ls, key, value, inserted);
+        } else if (Compare()(cur->_val.first, key)) {
           if (cur->rs == nullptr) {
-            cur->rs = new Node{new value_type(key, value), nullptr, nullptr, cur, 1};
+            res = cur->rs = pool.create(Node{value_type(key, value), nullptr, nullptr, cur, 1});
             ++_size;
             inserted = true;
-          } else inserted = insert(cur->rs, key, value);
+          } else res = insert(cur->rs, key, value, inserted);
         } else {
-          return false;
+          return cur;
         }
         skew(cur);
         split(cur);
-        return inserted;
+        return res;
       }
 
       /**
@@ -601,16 +598,16 @@ namespace arima_kana {
       void erase(iterator pos) {
         if (pos.pos == nullptr || pos.root == nullptr || pos.root->AAtree != AAtree)
           error("invalid_iterator");
-        _erase(AAtree, pos.pos->_val->first);
+        _erase(AAtree, pos.pos->_val.first);
       }
 
       bool _erase(Node *&cur, const Key &key) {
         if (cur == nullptr) return false;
-        if (Compare()(key, cur->_val->first)) {
+        if (Compare()(key, cur->_val.first)) {
           bool erased = _erase(cur->ls, key);
           if (erased) _adjust(cur);
           return erased;
-        } else if (Compare()(cur->_val->first, key)) {
+        } else if (Compare()(cur->_val.first, key)) {
           bool erased = _erase(cur->rs, key);
           if (erased) _adjust(cur);
           return erased;
@@ -622,8 +619,7 @@ namespace arima_kana {
           cur = (cur->ls == nullptr ? cur->rs : cur->ls);
           if (cur != nullptr) cur->fa = tmp->fa;
           tmp->fa = tmp->ls = tmp->rs = nullptr;
-          delete tmp->_val;
-          delete tmp;
+          pool.destroy(tmp);
           --_size;
         } else {
           Node *cur_pos = cur;
@@ -631,7 +627,7 @@ namespace arima_kana {
           while (tmp->ls != nullptr) {
             tmp = tmp->ls;
           }
-          Node *copy = new Node{new value_type(*(tmp->_val)), tmp->ls, tmp->rs, tmp->fa, tmp->level};
+          Node *copy = pool.create(Node{tmp->_val, tmp->ls, tmp->rs, tmp->fa, tmp->level});
           if (tmp->fa != nullptr)
             tmp->fa->ls == tmp ? tmp->fa->ls = copy : tmp->fa->rs = copy;
           if (tmp->ls != nullptr)
@@ -649,10 +645,9 @@ namespace arima_kana {
           if (cur_pos->rs != nullptr)
             cur_pos->rs->fa = tmp;
           cur_pos->fa = cur_pos->ls = cur_pos->rs = nullptr;
-          delete cur_pos->_val;
-          delete cur_pos;
+          pool.destroy(cur_pos);
           cur = tmp;
-          _erase(cur->rs, cur->_val->first);
+          _erase(cur->rs, cur->_val.first);
           _adjust(cur);
         }
         return true;
@@ -679,9 +674,9 @@ namespace arima_kana {
       Node *find_ptr(const Key &key) const {
         Node *cur = AAtree;
         while (cur != nullptr) {
-          if (Compare()(key, cur->_val->first)) {
+          if (Compare()(key, cur->_val.first)) {
             cur = cur->ls;
-          } else if (Compare()(cur->_val->first, key)) {
+          } else if (Compare()(cur->_val.first, key)) {
             cur = cur->rs;
           } else {
             return cur;
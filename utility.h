@@ -3,8 +3,15 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
 #include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace arima_kana {
 
@@ -50,13 +57,80 @@ namespace arima_kana {
       return is;
     }
 
+    inline uint64_t mum(uint64_t a, uint64_t b) {
+      unsigned __int128 r = (unsigned __int128) a * b;
+      return uint64_t(r) ^ uint64_t(r >> 64);
+    }
+
+    inline uint64_t read64(const unsigned char *p) {
+      uint64_t x;
+      memcpy(&x, p, 8);
+      return x;
+    }
+
+    inline uint64_t read32(const unsigned char *p) {
+      uint32_t x;
+      memcpy(&x, p, 4);
+      return x;
+    }
+
+    /// @hash_bytes
+    /// a wyhash-style hash of len bytes:
+    /// 16 bytes per step folded by 64x64->128 multiplications,
+    /// the tail read as (possibly overlapping) words, never past data + len
+    inline unsigned long long hash_bytes(const void *data, size_t len, uint64_t seed = 0) {
+      static constexpr uint64_t s0 = 0xa0761d6478bd642full, s1 = 0xe7037ed1a0b428dbull;
+      auto p = static_cast<const unsigned char *>(data);
+      seed ^= mum(seed ^ s0, s1);
+      uint64_t a, b;
+      if (len <= 16) {
+        if (len >= 4) {
+          size_t mid = (len >> 3) << 2;
+          a = read32(p) << 32 | read32(p + mid);
+          b = read32(p + len - 4) << 32 | read32(p + len - 4 - mid);
+        } else if (len > 0) {
+          a = uint64_t(p[0]) << 16 | uint64_t(p[len >> 1]) << 8 | p[len - 1];
+          b = 0;
+        } else {
+          a = b = 0;
+        }
+      } else {
+        size_t i = len;
+        for (; i > 16; i -= 16, p += 16) {
+          seed = mum(read64(p) ^ s1, read64(p + 8) ^ seed);
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+      }
+      unsigned __int128 r = (unsigned __int128) (a ^ s1) * (b ^ seed);
+      return mum(uint64_t(r) ^ s0 ^ len, uint64_t(r >> 64) ^ s1);
+    }
+
+    /// only the bytes before '\0' take part,
+    /// so that equal strings hash equally whatever follows the terminator
     template<int length>
     unsigned long long hash(const m_string<length> &key) {
-      unsigned long long h = 0;
-      for (int i = 0; i < length; i++) {
-        h = h * 1471 + key.id[i];
+      return hash_bytes(key.id, strnlen(key.id, length));
+    }
+
+    /// the object representation,
+    /// for plain keys without an overload of their own
+    template<class T>
+    unsigned long long hash(const T &key) {
+      return hash_bytes(&key, sizeof(T));
+    }
+
+    /// @visit
+    /// calls a visitor; one returning false asks the walk to stop,
+    /// one returning void never stops it
+    template<class F, class... Args>
+    bool visit(F &fn, Args &&... args) {
+      if constexpr (std::is_void_v<std::invoke_result_t<F &, Args...>>) {
+        fn(std::forward<Args>(args)...);
+        return true;
+      } else {
+        return fn(std::forward<Args>(args)...);
       }
-      return h;
     }
 
     template<class T1, class T2>
@@ -109,18 +183,49 @@ namespace arima_kana {
     template<class T1, class T2>
     pair(T1, T2) -> pair<T1, T2>;
 
+    /// @alloc_stats
+    /// number of heap allocations made through arima_kana::allocator;
+    /// atomic, as shard workers and parallel builds allocate concurrently
+    struct alloc_stats {
+      static inline std::atomic<size_t> allocations{0};
+
+      static void count() {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+      }
+    };
+
     template<typename T>
     struct allocator {
+      typedef T value_type;
+
+      static constexpr bool over_aligned = alignof(T) > alignof(std::max_align_t);
+
       T *allocate(size_t size) {
-        return (T *) malloc(sizeof(T) * size);
+        alloc_stats::count();
+        if constexpr (over_aligned) {
+          return static_cast<T *>(::operator new(sizeof(T) * size, std::align_val_t(alignof(T))));
+        } else {
+          return (T *) malloc(sizeof(T) * size);
+        }
       }
 
-      void deallocate(void *p) {
-        free(p);
+      void deallocate(T *p, size_t) {
+        if constexpr (over_aligned) {
+          ::operator delete(p, std::align_val_t(alignof(T)));
+        } else {
+          free(p);
+        }
+      }
+
+      /// only for trivially copyable T that is not over-aligned
+      T *reallocate(T *p, size_t, size_t size) {
+        alloc_stats::count();
+        return (T *) realloc(p, sizeof(T) * size);
       }
 
-      void construct(T *p, const T &val) {
-        new(p) T(val);
+      template<class... Args>
+      void construct(T *p, Args &&... args) {
+        new(p) T(std::forward<Args>(args)...);
       }
 
       void destroy(T *p) {
@@ -128,51 +233,289 @@ namespace arima_kana {
       }
     };
 
-    template<class T, class _alloc=std::allocator<T>>
+    template<class A, class = void>
+    struct has_reallocate : std::false_type {};
+
+    template<class A>
+    struct has_reallocate<A, std::void_t<decltype(std::declval<A &>().reallocate(nullptr, 0, 0))>>
+            : std::true_type {};
+
+    /// @local_store
+    /// inline room for n elements, used until a vector spills to the heap
+    template<class T, size_t n>
+    struct local_store {
+      alignas(T) unsigned char buf[n * sizeof(T)];
+
+      T *get() { return reinterpret_cast<T *>(buf); }
+
+      const T *get() const { return reinterpret_cast<const T *>(buf); }
+    };
+
+    template<class T>
+    struct local_store<T, 0> {
+      T *get() { return nullptr; }
+
+      const T *get() const { return nullptr; }
+    };
+
+    /// @Pool
+    /// an arena of T's carved from geometrically growing chunks.
+    /// Destroyed objects go to a free list and are reused;
+    /// release() drops every chunk at once without running destructors.
+    template<class T>
+    class Pool {
+      union Slot {
+        Slot *next;
+        alignas(T) unsigned char obj[sizeof(T)];
+      };
+
+      Slot *chunks = nullptr;// slot 0 of each chunk links to the previous chunk
+      Slot *cur = nullptr;
+      size_t left = 0;
+      size_t next_cap = 32;
+      Slot *free_list = nullptr;
+
+    public:
+      Pool() = default;
+
+      Pool(const Pool &) = delete;
+
+      Pool &operator=(const Pool &) = delete;
+
+      ~Pool() {
+        release();
+      }
+
+      template<class... Args>
+      T *create(Args &&... args) {
+        Slot *s;
+        if (free_list != nullptr) {
+          s = free_list;
+          free_list = free_list->next;
+        } else {
+          if (left == 0) {
+            Slot *chunk = new Slot[next_cap + 1];
+            chunk[0].next = chunks;
+            chunks = chunk;
+            cur = chunk + 1;
+            left = next_cap;
+            next_cap *= 2;
+          }
+          s = cur++;
+          --left;
+        }
+        return new(s->obj) T(std::forward<Args>(args)...);
+      }
+
+      void destroy(T *p) {
+        p->~T();
+        auto s = reinterpret_cast<Slot *>(p);
+        s->next = free_list;
+        free_list = s;
+      }
+
+      void release() {
+        while (chunks != nullptr) {
+          Slot *prev = chunks[0].next;
+          delete[] chunks;
+          chunks = prev;
+        }
+        cur = free_list = nullptr;
+        left = 0;
+        next_cap = 32;
+      }
+    };
+
+    /// @vector
+    /// allocates nothing until the first element arrives;
+    /// the first `local` elements are kept inline.
+    /// Trivially copyable elements grow by realloc.
+    template<class T, class _alloc = allocator<T>, size_t local = 0>
     class vector {
+      typedef std::allocator_traits<_alloc> traits;
+
+      static constexpr bool use_realloc = std::is_trivially_copyable_v<T> && has_reallocate<_alloc>::value &&
+                                          alignof(T) <= alignof(std::max_align_t);
+
       T *data;
       size_t _size;
       size_t _capacity;
       _alloc alloc;
+      local_store<T, local> store;
 
-      void double_space() {
-        _capacity *= 2;
-        T *tmp = alloc.allocate(_capacity);
+      bool on_heap() const {
+        return data != nullptr && data != store.get();
+      }
+
+      void reset() {
+        data = store.get();
+        _size = 0;
+        _capacity = local;
+      }
+
+      void release() {
+        for (size_t i = 0; i < _size; i++) {
+          traits::destroy(alloc, data + i);
+        }
+        if (on_heap()) traits::deallocate(alloc, data, _capacity);
+      }
+
+      /// @reallocate moves the elements to a buffer of cap >= _size elements
+      void reallocate(size_t cap) {
+        if constexpr (use_realloc) {
+          if (on_heap() && cap > local) {
+            T *tmp = alloc.reallocate(data, _capacity, cap);
+            if (tmp == nullptr) throw std::bad_alloc();
+            data = tmp;
+            _capacity = cap;
+            return;
+          }
+        }
+        T *tmp = cap <= local ? store.get() : traits::allocate(alloc, cap);
+        if (tmp == data) return;
         for (size_t i = 0; i < _size; i++) {
-          alloc.construct(tmp + i, data[i]);
+          traits::construct(alloc, tmp + i, std::move(data[i]));
+          traits::destroy(alloc, data + i);
         }
-        alloc.deallocate(data, _capacity / 2);
+        if (on_heap()) traits::deallocate(alloc, data, _capacity);
         data = tmp;
+        _capacity = cap < local ? local : cap;
+      }
+
+      void double_space() {
+        reallocate(_capacity == 0 ? 4 : _capacity * 2);
+      }
+
+      /// takes over the elements of other, leaving it empty
+      void steal(vector &other) {
+        if (other.on_heap()) {
+          data = other.data;
+          _size = other._size;
+          _capacity = other._capacity;
+        } else {
+          reset();
+          for (size_t i = 0; i < other._size; i++) {
+            traits::construct(alloc, data + i, std::move(other.data[i]));
+            traits::destroy(alloc, other.data + i);
+          }
+          _size = other._size;
+        }
+        other.reset();
       }
 
     public:
-      vector(size_t cap = 100) : _size(0), _capacity(cap) {
-        data = alloc.allocate(_capacity);
+      vector() {
+        reset();
       }
 
-      vector(const T &val, size_t cap = 100) : _size(cap), _capacity(cap) {
-        data = alloc.allocate(_capacity);
-        for (size_t i = 0; i < _size; i++) {
-          alloc.construct(data + i, val);
+      explicit vector(size_t cap) {
+        reset();
+        reserve(cap);
+      }
+
+      vector(const T &val, size_t n) {
+        reset();
+        reserve(n);
+        for (size_t i = 0; i < n; i++) {
+          traits::construct(alloc, data + i, val);
+        }
+        _size = n;
+      }
+
+      vector(const vector &other) {
+        reset();
+        reserve(other._size);
+        for (size_t i = 0; i < other._size; i++) {
+          traits::construct(alloc, data + i, other.data[i]);
+        }
+        _size = other._size;
+      }
+
+      vector(vector &&other) noexcept {
+        steal(other);
+      }
+
+      vector &operator=(const vector &other) {
+        if (this == &other) return *this;
+        clear();
+        reserve(other._size);
+        for (size_t i = 0; i < other._size; i++) {
+          traits::construct(alloc, data + i, other.data[i]);
         }
+        _size = other._size;
+        return *this;
+      }
+
+      vector &operator=(vector &&other) noexcept {
+        if (this == &other) return *this;
+        release();
+        steal(other);
+        return *this;
       }
 
       void push_back(const T &val) {
         if (_size == _capacity) {
+          if (&val >= data && &val < data + _size) {
+            T tmp(val);
+            double_space();
+            traits::construct(alloc, data + _size, std::move(tmp));
+            _size++;
+            return;
+          }
           double_space();
         }
-        alloc.construct(data + _size, val);
+        traits::construct(alloc, data + _size, val);
         _size++;
       }
 
+      void push_back(T &&val) {
+        emplace_back(std::move(val));
+      }
+
+      template<class... Args>
+      T &emplace_back(Args &&... args) {
+        if (_size == _capacity) {
+          T tmp(std::forward<Args>(args)...);
+          double_space();
+          traits::construct(alloc, data + _size, std::move(tmp));
+        } else {
+          traits::construct(alloc, data + _size, std::forward<Args>(args)...);
+        }
+        return data[_size++];
+      }
+
       size_t size() const {
         return _size;
       }
 
+      size_t capacity() const {
+        return _capacity;
+      }
+
       T &operator[](size_t idx) {
         return data[idx];
       }
 
+      const T &operator[](size_t idx) const {
+        return data[idx];
+      }
+
+      T *begin() {
+        return data;
+      }
+
+      T *end() {
+        return data + _size;
+      }
+
+      const T *begin() const {
+        return data;
+      }
+
+      const T *end() const {
+        return data + _size;
+      }
+
       T &back() {
         return data[_size - 1];
       }
@@ -181,64 +524,61 @@ namespace arima_kana {
         return data[0];
       }
 
-      bool empty() {
+      bool empty() const {
         return _size == 0;
       }
 
       void pop_back() {
         if (_size != 0) {
-          alloc.destroy(data + _size - 1);
+          traits::destroy(alloc, data + _size - 1);
           _size--;
         }
-//        if (_size < _capacity / 3) {
-//          _capacity /= 2;
-//          T *tmp = new T[_capacity];
-//          for (size_t i = 0; i < _size; i++) {
-//            tmp[i] = data[i];
-//          }
-//          delete[] data;
-//          data = tmp;
-//        }
       }
 
+      /// destroys the elements but keeps the capacity
       void clear() {
         for (size_t i = 0; i < _size; i++) {
-          alloc.destroy(data + i);
+          traits::destroy(alloc, data + i);
         }
-        alloc.deallocate(data, _capacity);
         _size = 0;
-        _capacity = 10;
-        data = alloc.allocate(_capacity);
       }
 
+      void reserve(size_t cap) {
+        if (cap > _capacity) reallocate(cap);
+      }
+
+      /// gives back unused capacity, returning to the inline store if possible
+      void shrink_to_fit() {
+        if (!on_heap() || _size == _capacity) return;
+        if (_size == 0 && local == 0) {
+          traits::deallocate(alloc, data, _capacity);
+          reset();
+          return;
+        }
+        reallocate(_size);
+      }
+
+      /// new elements are value-initialized
       void resize(size_t new_size) {
         if (new_size > _size) {
           if (new_size > _capacity) {
-            size_t old_capacity = _capacity;
-            while (_capacity < new_size) {
-              _capacity *= 2;
-            }
-            T *tmp = alloc.allocate(_capacity);
-            for (size_t i = 0; i < _size; i++) {
-              alloc.construct(tmp + i, data[i]);
-            }
-            alloc.deallocate(data, old_capacity);
-            data = tmp;
+            size_t cap = _capacity == 0 ? 4 : _capacity;
+            while (cap < new_size) cap *= 2;
+            reallocate(cap);
+          }
+          for (size_t i = _size; i < new_size; i++) {
+            traits::construct(alloc, data + i);
           }
-          _size = new_size;
         } else {
           for (size_t i = new_size; i < _size; i++) {
-            alloc.destroy(data + i);
+            traits::destroy(alloc, data + i);
           }
-          _size = new_size;
         }
+        _size = new_size;
       }
 
       ~vector() {
-        for (size_t i = 0; i < _size; i++) {
-          alloc.destroy(data + i);
-        }
-        alloc.deallocate(data, _capacity);
+        release();
       }
 
     };